@@ -501,7 +501,21 @@ void ClassDeclaration::semantic(Scope *sc)
             // Forward referencee of one or more bases, try again later
             scope = scx ? scx : sc->copy();
             scope->setNoFree();
+#if IN_LLVM
+            Dsymbol *dep = NULL;
+            for (size_t i = 0; i < baseclasses->dim; i++)
+            {
+                ClassDeclaration *cdb = (*baseclasses)[i]->base;
+                if (cdb && cdb->doAncestorsSemantic != SemanticDone)
+                {
+                    dep = cdb;
+                    break;
+                }
+            }
+            scope->module->addDeferredSemantic(this, dep);
+#else
             scope->module->addDeferredSemantic(this);
+#endif
             //printf("\tL%d semantic('%s') failed due to forward references\n", __LINE__, toChars());
             return;
         }
@@ -580,7 +594,11 @@ Lancestorsdone:
             scope->setNoFree();
             if (tc->sym->scope)
                 tc->sym->scope->module->addDeferredSemantic(tc->sym);
+#if IN_LLVM
+            scope->module->addDeferredSemantic(this, tc->sym);
+#else
             scope->module->addDeferredSemantic(this);
+#endif
             //printf("\tL%d semantic('%s') failed due to forward references\n", __LINE__, toChars());
             return;
         }
@@ -1434,7 +1452,21 @@ void InterfaceDeclaration::semantic(Scope *sc)
             // Forward referencee of one or more bases, try again later
             scope = scx ? scx : sc->copy();
             scope->setNoFree();
+#if IN_LLVM
+            Dsymbol *dep = NULL;
+            for (size_t i = 0; i < baseclasses->dim; i++)
+            {
+                ClassDeclaration *cdb = (*baseclasses)[i]->base;
+                if (cdb && cdb->doAncestorsSemantic != SemanticDone)
+                {
+                    dep = cdb;
+                    break;
+                }
+            }
+            scope->module->addDeferredSemantic(this, dep);
+#else
             scope->module->addDeferredSemantic(this);
+#endif
             return;
         }
         doAncestorsSemantic = SemanticDone;
@@ -1477,7 +1509,11 @@ Lancestorsdone:
             scope->setNoFree();
             if (tc->sym->scope)
                 tc->sym->scope->module->addDeferredSemantic(tc->sym);
+#if IN_LLVM
+            scope->module->addDeferredSemantic(this, tc->sym);
+#else
             scope->module->addDeferredSemantic(this);
+#endif
             return;
         }
     }
@@ -676,6 +676,55 @@ Expression *Xor(Type *type, Expression *e1, Expression *e2)
     return e;
 }
 
+#if IN_LLVM
+/* Return true if se is a packed CTFE array of a signed integral type, whose
+ * elements charAt() does not sign extend.
+ */
+static bool hasSignedElements(StringExp *se)
+{
+    Type *tb = se->type ? se->type->toBasetype() : NULL;
+    if (!tb || !tb->nextOf())
+        return false;
+    switch (tb->nextOf()->toBasetype()->ty)
+    {
+        case Tint8:
+        case Tint16:
+        case Tint32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Return element i of se, with the same value as the IntegerExp it stands
+ * for.
+ */
+static dinteger_t stringElement(StringExp *se, size_t i, bool issigned)
+{
+    dinteger_t value = se->charAt(i);
+    if (issigned)
+    {
+        switch (se->sz)
+        {
+            case 1:     return (d_int8)value;
+            case 2:     return (d_int16)value;
+            case 4:     return (d_int32)value;
+            default:    assert(0);
+        }
+    }
+    return value;
+}
+
+static int cmpElements(dinteger_t v1, dinteger_t v2, bool issigned)
+{
+    if (v1 == v2)
+        return 0;
+    if (issigned)
+        return (sinteger_t)v1 < (sinteger_t)v2 ? -1 : 1;
+    return v1 < v2 ? -1 : 1;
+}
+#endif
+
 /* Also returns EXP_CANT_INTERPRET if cannot be computed.
  */
 Expression *Equal(TOK op, Type *type, Expression *e1, Expression *e2)
@@ -777,9 +826,16 @@ Expression *Equal(TOK op, Type *type, Expression *e1, Expression *e2)
         else
         {
             cmp = 1;            // if dim1 winds up being 0
+#if IN_LLVM
+            bool issigned = hasSignedElements(es1);
+#endif
             for (size_t i = 0; i < dim1; i++)
             {
+#if IN_LLVM
+                uinteger_t c = stringElement(es1, i, issigned);
+#else
                 uinteger_t c = es1->charAt(i);
+#endif
                 Expression *ee2 = (*es2->elements)[i];
                 if (ee2->isConst() != 1)
                     return EXP_CANT_INTERPRET;
@@ -1352,6 +1408,9 @@ Expression *Slice(Type *type, Expression *e1, Expression *lwr, Expression *upr)
             es->sz = sz;
             es->committed = es1->committed;
             es->type = type;
+#if IN_LLVM
+            es->ctfePacked = es1->ctfePacked;
+#endif
             e = es;
         }
     }
@@ -1449,6 +1508,21 @@ int sliceCmpStringWithString(StringExp *se1, StringExp *se2, size_t lo1, size_t
     size_t sz = se1->sz;
     assert(sz == se2->sz);
 
+#if IN_LLVM
+    // memcmp() only orders unsigned bytes correctly
+    bool issigned = hasSignedElements(se1);
+    if (sz != 1 || issigned)
+    {
+        for (size_t j = 0; j < len; j++)
+        {
+            int c = cmpElements(stringElement(se1, lo1 + j, issigned),
+                                stringElement(se2, lo2 + j, issigned), issigned);
+            if (c)
+                return c;
+        }
+        return 0;
+    }
+#endif
     return memcmp(s1 + sz * lo1, s2 + sz * lo2, sz * len);
 }
 
@@ -1457,6 +1531,18 @@ int sliceCmpStringWithString(StringExp *se1, StringExp *se2, size_t lo1, size_t
  */
 int sliceCmpStringWithArray(StringExp *se1, ArrayLiteralExp *ae2, size_t lo1, size_t lo2, size_t len)
 {
+#if IN_LLVM
+    // The elements of packed arrays may be signed
+    bool issigned = hasSignedElements(se1);
+    for (size_t j = 0; j < len; j++)
+    {
+        int c = cmpElements(stringElement(se1, lo1 + j, issigned),
+                            (*ae2->elements)[j + lo2]->toInteger(), issigned);
+        if (c)
+            return c;
+    }
+    return 0;
+#else
     utf8_t *s = (utf8_t *)se1->string;
     size_t sz = se1->sz;
 
@@ -1477,6 +1563,7 @@ int sliceCmpStringWithArray(StringExp *se1, ArrayLiteralExp *ae2, size_t lo1, si
             return c;
     }
     return 0;
+#endif
 }
 
 /* Also return EXP_CANT_INTERPRET if this fails
@@ -1592,6 +1679,9 @@ Expression *Cat(Type *type, Expression *e1, Expression *e2)
         es->sz = sz;
         es->committed = es1->committed | es2->committed;
         es->type = type;
+#if IN_LLVM
+        es->ctfePacked = es1->ctfePacked || es2->ctfePacked;
+#endif
         e = es;
     }
     else if (e2->op == TOKstring && e1->op == TOKarrayliteral &&
@@ -1668,6 +1758,9 @@ Expression *Cat(Type *type, Expression *e1, Expression *e2)
         es->sz = sz;
         es->committed = es1->committed;
         es->type = type;
+#if IN_LLVM
+        es->ctfePacked = es1->ctfePacked;
+#endif
         e = es;
     }
     else if (e1->op == TOKint64 && e2->op == TOKstring)
@@ -1700,6 +1793,9 @@ Expression *Cat(Type *type, Expression *e1, Expression *e2)
         es->sz = sz;
         es->committed = es2->committed;
         es->type = type;
+#if IN_LLVM
+        es->ctfePacked = es2->ctfePacked;
+#endif
         e = es;
     }
     else if (e1->op == TOKarrayliteral && e2->op == TOKarrayliteral &&
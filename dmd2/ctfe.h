@@ -18,6 +18,8 @@
 
 #include "arraytypes.h"
 
+struct OutBuffer;
+
 /**
    Global status of the CTFE engine. Mostly used for performance diagnostics
  */
@@ -30,7 +32,91 @@ struct CtfeStatus
     static int maxCallDepth; // highest number of recursive calls
     static int numArrayAllocs; // Number of allocated arrays
     static int numAssignments; // total number of assignments executed
+#if IN_LLVM
+    static int numBytecodeFunctions; // functions compiled to bytecode
+    static int numBytecodeCalls; // calls run as bytecode
+    static int numBytecodeFallbacks; // calls given back to the interpreter
+    static int numPackedArrays; // integral arrays created as packed literals
+    static int numArrayAppendsInPlace; // appends that reused spare capacity
+    static int numMemoHits; // pure calls answered by a memoized result
+    static int numMemoMisses; // pure calls that had to be evaluated
+#endif
+};
+
+#if IN_LLVM
+// Print the statistics of the CTFE engine for -v
+void printCtfePerformanceStats();
+// Print the CTFE profile for -vctfe-profile, the most expensive functions first
+void printCtfeProfile();
+// Write the CTFE profile as a JSON array for -vctfe-profile-json
+void writeCtfeProfileJson(OutBuffer *buf);
+
+/**
+  A region for the values the interpreter builds while a top-level CTFE
+  evaluation is running, if enabled by -ctfe-arena: the copies of literals,
+  block duplicated and resized arrays, concatenations and packed arrays.
+  They are allocated in it explicitly (see ctfeNew in ctfeexpr.c), everything
+  else, like the AST created by semantic run lazily during the evaluation,
+  is on the heap. Only the result of the evaluation is copied out of the
+  arena (see copyOutOfArena), after which all the intermediate values are
+  released at once.
+
+  Values that are kept beyond the evaluation, like memoized calls, must be
+  copied while the arena is suspended by a CtfeArenaSuspend.
+ */
+class CtfeArena
+{
+public:
+    static CtfeArena *current;  // the active arena, NULL to use the heap
+    static int numReleased;     // arenas released after their evaluation
+    static int numKept;         // arenas kept because of an unusual result
+    static size_t bytesReleased;
+
+    /// Allocates size bytes in the current arena, or on the heap.
+    static void *allocate(size_t size);
+
+    /// Makes the new arena the current one until it is destroyed.
+    CtfeArena();
+    ~CtfeArena();
+
+    /// Don't release the memory, because the result still refers to it.
+    void keep() { kept = true; }
+
+private:
+    CtfeArena *previous;
+    Array<void *> chunks;
+    char *ptr;                  // free space in the last chunk
+    size_t left;
+    size_t used;
+    bool kept;
+
+    CtfeArena(const CtfeArena &);
+    void operator=(const CtfeArena &);
+};
+
+/// Allocates on the heap for as long as it is in scope.
+struct CtfeArenaSuspend
+{
+    CtfeArena *saved;
+    CtfeArenaSuspend() : saved(CtfeArena::current) { CtfeArena::current = NULL; }
+    ~CtfeArenaSuspend() { CtfeArena::current = saved; }
 };
+#endif
+
+#if IN_LLVM
+/**
+  The spare capacity behind the data of a StringExp that was built by ~=
+  in CTFE. Like the D runtime does for heap arrays, the block remembers
+  how many elements are in use, so that only the array ending there may
+  grow in place; any other array sharing the data gets a copy when
+  appended to.
+ */
+struct CtfeArrayBlock
+{
+    size_t capacity; // number of elements the data can hold
+    size_t used;     // number of elements in use
+};
+#endif
 
 /**
   A reference to a class, or an interface. We need this when we
@@ -132,6 +218,23 @@ ArrayLiteralExp *createBlockDuplicatedArrayLiteral(Loc loc, Type *type,
 StringExp *createBlockDuplicatedStringLiteral(Loc loc, Type *type,
         unsigned value, size_t dim, unsigned char sz);
 
+#if IN_LLVM
+/// True if CTFE values of type t are kept packed in a StringExp, i.e. t is a
+/// dynamic array of chars or of integers of at most 4 bytes.
+bool isPackedCtfeArray(Type *t);
+
+/// Returns e1 ~ e2 for the ~= operator, reusing the spare capacity of e1
+/// if possible. Returns NULL if the result is not a packed array.
+Expression *ctfeAppend(Loc loc, Type *type, Expression *e1, Expression *e2);
+
+/// Convert a packed array into the form expected outside of CTFE.
+Expression *unpackArrayLiteral(StringExp *se);
+
+/// Return a deep copy of CTFE value e, allocated outside of any arena, or
+/// NULL if e contains expressions that cannot be copied.
+Expression *copyOutOfArena(Expression *e);
+#endif
+
 
 /* Set dest = src, where both dest and src are container value literals
  * (ie, struct literals, or static arrays (can be an array literal or a string)
@@ -13,6 +13,9 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>                     // mem{cpy|set}()
+#if IN_LLVM
+#include <new>
+#endif
 
 #include "rmem.h"
 
@@ -24,9 +27,39 @@
 #include "template.h"
 #include "ctfe.h"
 #include "target.h"
+#if IN_LLVM
+#include "aav.h"
+#endif
 
 int RealEquals(real_t x1, real_t x2);
 
+#if IN_LLVM
+// Like mem.calloc, but in the current CTFE arena
+static void *ctfeCalloc(size_t n, size_t size)
+{
+    void *p = CtfeArena::allocate(n * size);
+    memset(p, 0, n * size);
+    return p;
+}
+
+// Like e->copy(), but in the current CTFE arena
+static Expression *ctfeCopy(Expression *e)
+{
+    void *p = CtfeArena::allocate(e->size);
+    return (Expression *)memcpy(p, (void *)e, e->size);
+}
+
+/* Allocates a new T in the current CTFE arena, e.g.
+ *   ctfeNew(IntegerExp)(loc, value, type)
+ * Only the values built by the interpreter itself are allocated like this,
+ * everything else (in particular the AST built by semantic) is on the heap.
+ */
+#define ctfeNew(T)  new (CtfeArena::allocate(sizeof(T))) T
+#else
+#define ctfeCopy(e) ((e)->copy())
+#define ctfeNew(T)  new T
+#endif
+
 /************** ClassReferenceExp ********************************************/
 
 ClassReferenceExp::ClassReferenceExp(Loc loc, StructLiteralExp *lit, Type *type)
@@ -224,20 +257,27 @@ Expression *copyLiteral(Expression *e)
     if (e->op == TOKstring) // syntaxCopy doesn't make a copy for StringExp!
     {
         StringExp *se = (StringExp *)e;
+#if IN_LLVM
+        utf8_t *s = (utf8_t *)ctfeCalloc(se->len + 1, se->sz);
+#else
         utf8_t *s = (utf8_t *)mem.calloc(se->len + 1, se->sz);
+#endif
         memcpy(s, se->string, se->len * se->sz);
-        StringExp *se2 = new StringExp(se->loc, s, se->len);
+        StringExp *se2 = ctfeNew(StringExp)(se->loc, s, se->len);
         se2->committed = se->committed;
         se2->postfix = se->postfix;
         se2->type = se->type;
         se2->sz = se->sz;
         se2->ownedByCtfe = true;
+#if IN_LLVM
+        se2->ctfePacked = se->ctfePacked;
+#endif
         return se2;
     }
     else if (e->op == TOKarrayliteral)
     {
         ArrayLiteralExp *ae = (ArrayLiteralExp *)e;
-        ArrayLiteralExp *r = new ArrayLiteralExp(e->loc,
+        ArrayLiteralExp *r = ctfeNew(ArrayLiteralExp)(e->loc,
             copyLiteralArray(ae->elements));
         r->type = e->type;
         r->ownedByCtfe = true;
@@ -246,7 +286,7 @@ Expression *copyLiteral(Expression *e)
     else if (e->op == TOKassocarrayliteral)
     {
         AssocArrayLiteralExp *aae = (AssocArrayLiteralExp *)e;
-        AssocArrayLiteralExp *r = new AssocArrayLiteralExp(e->loc,
+        AssocArrayLiteralExp *r = ctfeNew(AssocArrayLiteralExp)(e->loc,
             copyLiteralArray(aae->keys), copyLiteralArray(aae->values));
         r->type = e->type;
         r->ownedByCtfe = true;
@@ -282,7 +322,7 @@ Expression *copyLiteral(Expression *e)
                 m = copyLiteral(m);
             (*newelems)[i] = m;
         }
-        StructLiteralExp *r = new StructLiteralExp(e->loc, se->sd, newelems, se->stype);
+        StructLiteralExp *r = ctfeNew(StructLiteralExp)(e->loc, se->sd, newelems, se->stype);
         r->type = e->type;
         r->ownedByCtfe = true;
         r->origin = ((StructLiteralExp*)e)->origin;
@@ -296,7 +336,7 @@ Expression *copyLiteral(Expression *e)
             || e->op == TOKvoid || e->op == TOKvector)
     {
         // Simple value types
-        Expression *r = e->copy();  // keep e1 for DelegateExp and DotVarExp
+        Expression *r = ctfeCopy(e);  // keep e1 for DelegateExp and DotVarExp
         r->type = e->type;
         return r;
     }
@@ -305,12 +345,12 @@ Expression *copyLiteral(Expression *e)
         // For pointers, we only do a shallow copy.
         Expression *r;
         if (e->op == TOKaddress)
-            r = new AddrExp(e->loc, ((AddrExp *)e)->e1);
+            r = ctfeNew(AddrExp)(e->loc, ((AddrExp *)e)->e1);
         else if (e->op == TOKindex)
-            r = new IndexExp(e->loc, ((IndexExp *)e)->e1, ((IndexExp *)e)->e2);
+            r = ctfeNew(IndexExp)(e->loc, ((IndexExp *)e)->e1, ((IndexExp *)e)->e2);
         else if (e->op == TOKdotvar)
         {
-            r = new DotVarExp(e->loc, ((DotVarExp *)e)->e1,
+            r = ctfeNew(DotVarExp)(e->loc, ((DotVarExp *)e)->e1,
                 ((DotVarExp *)e)->var, ((DotVarExp *)e)->hasOverloads);
         }
         else
@@ -321,13 +361,13 @@ Expression *copyLiteral(Expression *e)
     else if (e->op == TOKslice)
     {
         // Array slices only do a shallow copy
-        Expression *r = new SliceExp(e->loc, ((SliceExp *)e)->e1,
+        Expression *r = ctfeNew(SliceExp)(e->loc, ((SliceExp *)e)->e1,
             ((SliceExp *)e)->lwr, ((SliceExp *)e)->upr);
         r->type = e->type;
         return r;
     }
     else if (e->op == TOKclassreference)
-        return new ClassReferenceExp(e->loc, ((ClassReferenceExp *)e)->value, e->type);
+        return ctfeNew(ClassReferenceExp)(e->loc, ((ClassReferenceExp *)e)->value, e->type);
     else if (e->op == TOKerror)
         return e;
     else
@@ -460,7 +500,7 @@ ArrayLiteralExp *createBlockDuplicatedArrayLiteral(Loc loc, Type *type,
             elem  = copyLiteral(elem);
         (*elements)[i] = elem;
     }
-    ArrayLiteralExp *ae = new ArrayLiteralExp(loc, elements);
+    ArrayLiteralExp *ae = ctfeNew(ArrayLiteralExp)(loc, elements);
     ae->type = type;
     ae->ownedByCtfe = true;
     return ae;
@@ -473,7 +513,11 @@ ArrayLiteralExp *createBlockDuplicatedArrayLiteral(Loc loc, Type *type,
 StringExp *createBlockDuplicatedStringLiteral(Loc loc, Type *type,
         unsigned value, size_t dim, unsigned char sz)
 {
+#if IN_LLVM
+    utf8_t *s = (utf8_t *)ctfeCalloc(dim + 1, sz);
+#else
     utf8_t *s = (utf8_t *)mem.calloc(dim + 1, sz);
+#endif
     for (size_t elemi = 0; elemi < dim; ++elemi)
     {
         switch (sz)
@@ -484,7 +528,7 @@ StringExp *createBlockDuplicatedStringLiteral(Loc loc, Type *type,
             default:    assert(0);
         }
     }
-    StringExp *se = new StringExp(loc, s, dim);
+    StringExp *se = ctfeNew(StringExp)(loc, s, dim);
     se->type = type;
     se->sz = sz;
     se->committed = true;
@@ -492,6 +536,371 @@ StringExp *createBlockDuplicatedStringLiteral(Loc loc, Type *type,
     return se;
 }
 
+#if IN_LLVM
+/******************************
+ * Packed arrays.
+ * Dynamic arrays of small integers are kept in a StringExp instead of an
+ * ArrayLiteralExp of IntegerExps, just like strings are, which makes them
+ * far cheaper to create, copy and modify. Appends with ~= are amortized
+ * by allocating spare capacity, see CtfeArrayBlock.
+ */
+bool isPackedCtfeArray(Type *t)
+{
+    t = t->toBasetype();
+    if (t->ty != Tarray)
+        return false;
+    switch (t->nextOf()->toBasetype()->ty)
+    {
+        case Tchar:
+        case Twchar:
+        case Tdchar:
+        case Tint8:
+        case Tuns8:
+        case Tint16:
+        case Tuns16:
+        case Tint32:
+        case Tuns32:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void setPackedElement(void *s, unsigned char sz, size_t i, dinteger_t value)
+{
+    switch (sz)
+    {
+        case 1:     ((utf8_t *)s)[i] = (utf8_t)value; break;
+        case 2:     ((unsigned short *)s)[i] = (unsigned short)value; break;
+        case 4:     ((unsigned *)s)[i] = (unsigned)value; break;
+        default:    assert(0);
+    }
+}
+
+// Return true if all elements are integer literals
+static bool isIntegerArrayLiteral(ArrayLiteralExp *ae)
+{
+    for (size_t i = 0; i < ae->elements->dim; i++)
+    {
+        if ((*ae->elements)[i]->op != TOKint64)
+            return false;
+    }
+    return true;
+}
+
+Expression *ctfeAppend(Loc loc, Type *type, Expression *e1, Expression *e2)
+{
+    if (!isPackedCtfeArray(type))
+        return NULL;
+    Type *elemType = type->toBasetype()->nextOf()->toBasetype();
+    unsigned char sz = (unsigned char)elemType->size();
+
+    StringExp *se1 = NULL;
+    ArrayLiteralExp *ae1 = NULL;
+    size_t len1 = 0;
+    if (e1->op == TOKstring && ((StringExp *)e1)->sz == sz)
+    {
+        se1 = (StringExp *)e1;
+        len1 = se1->len;
+    }
+    else if (e1->op == TOKarrayliteral && isIntegerArrayLiteral((ArrayLiteralExp *)e1))
+    {
+        ae1 = (ArrayLiteralExp *)e1;
+        len1 = ae1->elements->dim;
+    }
+    else if (e1->op != TOKnull)
+        return NULL;
+
+    StringExp *se2 = NULL;
+    ArrayLiteralExp *ae2 = NULL;
+    size_t len2 = 0;
+    if (e2->op == TOKint64 && e2->type->toBasetype()->size() == sz)
+        len2 = 1;   // anything else, like char[] ~ dchar, needs to be encoded
+    else if (e2->op == TOKstring && ((StringExp *)e2)->sz == sz)
+    {
+        se2 = (StringExp *)e2;
+        len2 = se2->len;
+    }
+    else if (e2->op == TOKarrayliteral && isIntegerArrayLiteral((ArrayLiteralExp *)e2))
+    {
+        ae2 = (ArrayLiteralExp *)e2;
+        len2 = ae2->elements->dim;
+    }
+    else
+        return NULL;
+
+    size_t len = len1 + len2;
+    CtfeArrayBlock *block;
+    void *s;
+    if (se1 && se1->ownedByCtfe && se1->ctfeBlock &&
+        se1->ctfeBlock->used == len1 && len <= se1->ctfeBlock->capacity)
+    {
+        // e1 ends where the used part of its block ends, so nothing else
+        // can see the elements written behind it.
+        block = se1->ctfeBlock;
+        s = se1->string;
+        ++CtfeStatus::numArrayAppendsInPlace;
+    }
+    else
+    {
+        block = (CtfeArrayBlock *)CtfeArena::allocate(sizeof(CtfeArrayBlock));
+        block->capacity = len < 8 ? 16 : 2 * len;
+        s = CtfeArena::allocate((block->capacity + 1) * sz);
+        if (se1)
+            memcpy(s, se1->string, len1 * sz);
+        for (size_t i = 0; ae1 && i < len1; i++)
+            setPackedElement(s, sz, i, (*ae1->elements)[i]->toInteger());
+        ++CtfeStatus::numArrayAllocs;
+        if (!se1 && elemType->ty != Tchar && elemType->ty != Twchar && elemType->ty != Tdchar)
+            ++CtfeStatus::numPackedArrays;
+    }
+
+    if (se2)
+        memcpy((utf8_t *)s + len1 * sz, se2->string, len2 * sz);
+    else if (ae2)
+    {
+        for (size_t i = 0; i < len2; i++)
+            setPackedElement(s, sz, len1 + i, (*ae2->elements)[i]->toInteger());
+    }
+    else
+        setPackedElement(s, sz, len1, e2->toInteger());
+    // Add terminating 0
+    setPackedElement(s, sz, len, 0);
+    block->used = len;
+
+    StringExp *se = ctfeNew(StringExp)(loc, s, len);
+    se->type = type;
+    se->sz = sz;
+    se->committed = se1 ? se1->committed : 1;
+    if (se2)
+        se->committed |= se2->committed;
+    se->ownedByCtfe = true;
+    se->ctfeBlock = block;
+    // Appending to a string gives a string outside of CTFE as well
+    se->ctfePacked = se1 ? se1->ctfePacked : !se2;
+    if (se2 && se2->ctfePacked)
+        se->ctfePacked = true;
+    return se;
+}
+
+Expression *unpackArrayLiteral(StringExp *se)
+{
+    Type *tb = se->type->toBasetype();
+    if (tb->ty != Tarray && tb->ty != Tsarray)
+        return se;
+    Type *elemType = tb->nextOf();
+    Type *telem = elemType->toBasetype();
+    if (telem->ty == Tchar || telem->ty == Twchar || telem->ty == Tdchar)
+    {
+        // Drop the spare capacity, which may hold the elements of another
+        // array appended in place.
+        return se->ownedByCtfe && se->ctfeBlock ? copyLiteral(se) : se;
+    }
+    // Strings with integral elements which were not packed by CTFE, like
+    // cast(ubyte[])"ab" or import() data, are kept as they are.
+    if (!se->ctfePacked || !telem->isintegral())
+        return se;
+
+    Expressions *elements = new Expressions();
+    elements->setDim(se->len);
+    for (size_t i = 0; i < se->len; i++)
+        (*elements)[i] = new IntegerExp(se->loc, se->charAt(i), elemType);
+    ArrayLiteralExp *ae = new ArrayLiteralExp(se->loc, elements);
+    ae->type = se->type;
+    return ae;
+}
+
+/******************************
+ * CTFE arenas.
+ */
+#define CTFE_ARENA_CHUNK (1024 * 1024 - 64)
+
+CtfeArena *CtfeArena::current = NULL;
+int CtfeArena::numReleased = 0;
+int CtfeArena::numKept = 0;
+size_t CtfeArena::bytesReleased = 0;
+
+void *CtfeArena::allocate(size_t size)
+{
+    CtfeArena *a = current;
+    if (!a)
+        return mem.malloc(size);
+
+    // 16 byte alignment is better (and sometimes needed) for doubles
+    size = (size + 15) & ~(size_t)15;
+    a->used += size;
+    if (size > CTFE_ARENA_CHUNK / 4)
+    {
+        void *p = mem.malloc(size);
+        a->chunks.push(p);
+        return p;
+    }
+    if (size > a->left)
+    {
+        a->ptr = (char *)mem.malloc(CTFE_ARENA_CHUNK);
+        a->chunks.push(a->ptr);
+        a->left = CTFE_ARENA_CHUNK;
+    }
+    void *p = a->ptr;
+    a->ptr += size;
+    a->left -= size;
+    return p;
+}
+
+CtfeArena::CtfeArena()
+{
+    previous = current;
+    ptr = NULL;
+    left = 0;
+    used = 0;
+    kept = false;
+    current = this;
+}
+
+CtfeArena::~CtfeArena()
+{
+    assert(current == this);
+    current = previous;
+    if (kept)
+    {
+        numKept++;
+        return;
+    }
+    for (size_t i = 0; i < chunks.dim; i++)
+        mem.free(chunks[i]);
+    numReleased++;
+    bytesReleased += used;
+}
+
+struct ArenaCopier
+{
+    AA *copies;     // the copies of the aggregate literals, to keep them shared
+    bool failed;
+
+    ArenaCopier() : copies(NULL), failed(false) { }
+
+    Expressions *copyArray(Expressions *elems)
+    {
+        if (!elems)
+            return NULL;
+        Expressions *r = new Expressions();
+        r->setDim(elems->dim);
+        for (size_t i = 0; i < elems->dim; i++)
+            (*r)[i] = (*elems)[i] ? copy((*elems)[i]) : NULL;
+        return r;
+    }
+
+    Expression *copy(Expression *e)
+    {
+        bool aggregate = e->op == TOKarrayliteral || e->op == TOKassocarrayliteral ||
+            e->op == TOKstructliteral || e->op == TOKclassreference;
+        if (aggregate)
+        {
+            Expression *r = (Expression *)dmd_aaGetRvalue(copies, e);
+            if (r)
+                return r;
+        }
+
+        Expression *r = e->copy();
+        if (aggregate)
+            *dmd_aaGet(&copies, e) = r;
+
+        switch (e->op)
+        {
+            case TOKint64:
+            case TOKfloat64:
+            case TOKcomplex80:
+            case TOKnull:
+            case TOKvoid:
+            case TOKerror:
+            case TOKvar:
+            case TOKsymoff:
+            case TOKfunction:
+            case TOKtypeid:
+                break;
+
+            case TOKstring:
+            {
+                StringExp *se = (StringExp *)r;
+                utf8_t *s = (utf8_t *)mem.malloc((se->len + 1) * se->sz);
+                memcpy(s, se->string, se->len * se->sz);
+                memset(s + se->len * se->sz, 0, se->sz);
+                se->string = s;
+                se->ctfeBlock = NULL;
+                break;
+            }
+
+            case TOKarrayliteral:
+            {
+                ArrayLiteralExp *ae = (ArrayLiteralExp *)r;
+                ae->elements = copyArray(ae->elements);
+                break;
+            }
+
+            case TOKassocarrayliteral:
+            {
+                AssocArrayLiteralExp *aae = (AssocArrayLiteralExp *)r;
+                aae->keys = copyArray(aae->keys);
+                aae->values = copyArray(aae->values);
+                break;
+            }
+
+            case TOKstructliteral:
+            {
+                StructLiteralExp *sle = (StructLiteralExp *)r;
+                sle->elements = copyArray(sle->elements);
+                sle->origin = sle;
+                sle->inlinecopy = NULL;
+                break;
+            }
+
+            case TOKclassreference:
+            {
+                ClassReferenceExp *cre = (ClassReferenceExp *)r;
+                cre->value = (StructLiteralExp *)copy(cre->value);
+                break;
+            }
+
+            case TOKaddress:
+            case TOKdotvar:
+            case TOKdelegate:
+            case TOKvector:
+                ((UnaExp *)r)->e1 = copy(((UnaExp *)r)->e1);
+                break;
+
+            case TOKindex:
+                ((BinExp *)r)->e1 = copy(((BinExp *)r)->e1);
+                ((BinExp *)r)->e2 = copy(((BinExp *)r)->e2);
+                break;
+
+            case TOKslice:
+            {
+                SliceExp *se = (SliceExp *)r;
+                se->e1 = copy(se->e1);
+                if (se->lwr)
+                    se->lwr = copy(se->lwr);
+                if (se->upr)
+                    se->upr = copy(se->upr);
+                break;
+            }
+
+            default:
+                failed = true;
+                break;
+        }
+        return r;
+    }
+};
+
+Expression *copyOutOfArena(Expression *e)
+{
+    CtfeArenaSuspend suspend;
+    ArenaCopier copier;
+    Expression *r = copier.copy(e);
+    return copier.failed ? NULL : r;
+}
+#endif
+
 // Return true if t is an AA
 bool isAssocArray(Type *t)
 {
@@ -1537,7 +1946,11 @@ Expression *ctfeCat(Type *type, Expression *e1, Expression *e2)
         size_t len = es1->len + es2->elements->dim;
         unsigned char sz = es1->sz;
 
+#if IN_LLVM
+        void *s = CtfeArena::allocate((len + 1) * sz);
+#else
         void *s = mem.malloc((len + 1) * sz);
+#endif
         memcpy((char *)s + sz * es2->elements->dim, es1->string, es1->len * sz);
         for (size_t i = 0; i < es2->elements->dim; i++)
         {
@@ -1560,10 +1973,13 @@ Expression *ctfeCat(Type *type, Expression *e1, Expression *e2)
         // Add terminating 0
         memset((utf8_t *)s + len * sz, 0, sz);
 
-        StringExp *es = new StringExp(loc, s, len);
+        StringExp *es = ctfeNew(StringExp)(loc, s, len);
         es->sz = sz;
         es->committed = 0;
         es->type = type;
+#if IN_LLVM
+        es->ctfePacked = es1->ctfePacked;
+#endif
         e = es;
         return e;
     }
@@ -1577,7 +1993,11 @@ Expression *ctfeCat(Type *type, Expression *e1, Expression *e2)
         size_t len = es1->len + es2->elements->dim;
         unsigned char sz = es1->sz;
 
+#if IN_LLVM
+        void *s = CtfeArena::allocate((len + 1) * sz);
+#else
         void *s = mem.malloc((len + 1) * sz);
+#endif
         memcpy(s, es1->string, es1->len * sz);
         for (size_t i = 0; i < es2->elements->dim; i++)
         {
@@ -1600,10 +2020,13 @@ Expression *ctfeCat(Type *type, Expression *e1, Expression *e2)
         // Add terminating 0
         memset((utf8_t *)s + len * sz, 0, sz);
 
-        StringExp *es = new StringExp(loc, s, len);
+        StringExp *es = ctfeNew(StringExp)(loc, s, len);
         es->sz = sz;
         es->committed = 0; //es1->committed;
         es->type = type;
+#if IN_LLVM
+        es->ctfePacked = es1->ctfePacked;
+#endif
         e = es;
         return e;
     }
@@ -1614,7 +2037,7 @@ Expression *ctfeCat(Type *type, Expression *e1, Expression *e2)
         ArrayLiteralExp *es1 = (ArrayLiteralExp *)e1;
         ArrayLiteralExp *es2 = (ArrayLiteralExp *)e2;
 
-        es1 = new ArrayLiteralExp(es1->loc, copyLiteralArray(es1->elements));
+        es1 = ctfeNew(ArrayLiteralExp)(es1->loc, copyLiteralArray(es1->elements));
         es1->elements->insert(es1->elements->dim, copyLiteralArray(es2->elements));
         e = es1;
         e->type = type;
@@ -1888,7 +2311,11 @@ Expression *changeArrayLiteralLength(Loc loc, TypeArray *arrayType,
     if (oldval->op == TOKstring)
     {
         StringExp *oldse = (StringExp *)oldval;
+#if IN_LLVM
+        utf8_t *s = (utf8_t *)ctfeCalloc(newlen + 1, oldse->sz);
+#else
         utf8_t *s = (utf8_t *)mem.calloc(newlen + 1, oldse->sz);
+#endif
         memcpy(s, oldse->string, copylen * oldse->sz);
         unsigned defaultValue = (unsigned)(defaultElem->toInteger());
         for (size_t elemi = copylen; elemi < newlen; ++elemi)
@@ -1901,11 +2328,14 @@ Expression *changeArrayLiteralLength(Loc loc, TypeArray *arrayType,
                 default:    assert(0);
             }
         }
-        StringExp *se = new StringExp(loc, s, newlen);
+        StringExp *se = ctfeNew(StringExp)(loc, s, newlen);
         se->type = arrayType;
         se->sz = oldse->sz;
         se->committed = oldse->committed;
         se->ownedByCtfe = true;
+#if IN_LLVM
+        se->ctfePacked = oldse->ctfePacked;
+#endif
         return se;
     }
     else
@@ -1927,7 +2357,7 @@ Expression *changeArrayLiteralLength(Loc loc, TypeArray *arrayType,
             for (size_t i = copylen; i < newlen; i++)
                 (*elements)[i] = defaultElem;
         }
-        ArrayLiteralExp *aae = new ArrayLiteralExp(loc, elements);
+        ArrayLiteralExp *aae = ctfeNew(ArrayLiteralExp)(loc, elements);
         aae->type = arrayType;
         aae->ownedByCtfe = true;
         return aae;
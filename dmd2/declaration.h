@@ -750,6 +750,14 @@ public:
 
     // true if set with the pragma(LDC_never_inline); stmt
     bool neverInline;
+
+    // true if fbody is still the syntax tree of the template this function
+    // was copied from, see copyBodyTo()
+    bool fbodyShared;
+    static bool shareBodies;
+
+    void copyBodyTo(FuncDeclaration *f);
+    void unshareBody();
 #endif
 
     void accept(Visitor *v) { v->visit(this); }
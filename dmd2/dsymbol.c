@@ -916,7 +916,97 @@ Dsymbol *ScopeDsymbol::syntaxCopy(Dsymbol *s)
  * Be very, very careful about slowing it down.
  */
 
+#if IN_LLVM
+/* Searching the imports of a scope means searching all imported modules,
+ * and their public imports recursively, for every identifier that is not
+ * declared in the scope itself. The results are cached per scope, identifier
+ * and flags, and invalidated as a whole (by bumping searchGeneration) when
+ * an import is added or a symbol is inserted into a module, namespace or
+ * template mixin, i.e. anything that could be reached through an import.
+ */
+struct SearchCacheKey
+{
+    ScopeDsymbol *sds;
+    Identifier *ident;
+    int flags;
+};
+
+struct SearchCacheEntry
+{
+    unsigned generation;
+    Dsymbol *s;
+};
+
+unsigned ScopeDsymbol::searchGeneration = 1;
+static StringTable searchCache;
+static bool searchCacheInited;
+static unsigned long long searchCacheHits;
+static unsigned long long searchCacheMisses;
+
 Dsymbol *ScopeDsymbol::search(Loc loc, Identifier *ident, int flags)
+{
+    // Symbols declared in this scope are found quickly anyway.
+    Dsymbol *s = symtab ? symtab->lookup(ident) : NULL;
+    if (s || !imports)
+        return s;
+
+    if (!searchCacheInited)
+    {
+        searchCache._init(1024);
+        searchCacheInited = true;
+    }
+    SearchCacheKey key;
+    memset(&key, 0, sizeof(key));   // the padding is hashed, too
+    key.sds = this;
+    key.ident = ident;
+    key.flags = flags;
+    StringValue *sv = searchCache.update((char *)&key, sizeof(key));
+    SearchCacheEntry *entry = (SearchCacheEntry *)sv->ptrvalue;
+    if (entry && entry->generation == searchGeneration)
+    {
+        searchCacheHits++;
+        return entry->s;
+    }
+    searchCacheMisses++;
+
+    unsigned errors = global.errors;
+    unsigned generation = searchGeneration;
+    unsigned cutoffDepth = Module::searchCutoffDepth;
+    Module::searchCutoffDepth = ~0u;
+    s = searchUncached(loc, ident, flags);
+    bool complete = Module::searchCutoffDepth >= Module::searchDepth;
+    if (cutoffDepth < Module::searchCutoffDepth)
+        Module::searchCutoffDepth = cutoffDepth;
+
+    /* Don't cache results which came with diagnostics (as they need to be
+     * reproduced by the next search), or which are incomplete because an
+     * import cycle led back to a module that is being searched further up
+     * the stack (Module::search() returns NULL for it).
+     */
+    if (errors == global.errors && generation == searchGeneration && complete)
+    {
+        if (!entry)
+        {
+            entry = (SearchCacheEntry *)mem.malloc(sizeof(SearchCacheEntry));
+            sv->ptrvalue = entry;
+        }
+        entry->generation = searchGeneration;
+        entry->s = s;
+    }
+    return s;
+}
+
+void ScopeDsymbol::printSearchCacheStatistics()
+{
+    unsigned long long total = searchCacheHits + searchCacheMisses;
+    fprintf(global.stdmsg, "search    %llu of %llu import searches cached (%.1f%%)\n",
+        searchCacheHits, total, total ? 100.0 * searchCacheHits / total : 0.0);
+}
+
+Dsymbol *ScopeDsymbol::searchUncached(Loc loc, Identifier *ident, int flags)
+#else
+Dsymbol *ScopeDsymbol::search(Loc loc, Identifier *ident, int flags)
+#endif
 {
     //printf("%s->ScopeDsymbol::search(ident='%s', flags=x%x)\n", toChars(), ident->toChars(), flags);
     //if (strcmp(ident->toChars(),"c") == 0) *(char*)0=0;
@@ -1099,7 +1189,12 @@ void ScopeDsymbol::importScope(Dsymbol *s, PROT protection)
                 if (ss == s)                    // if already imported
                 {
                     if (protection > prots[i])
+                    {
                         prots[i] = protection;  // upgrade access
+#if IN_LLVM
+                        searchGeneration++;
+#endif
+                    }
                     return;
                 }
             }
@@ -1107,6 +1202,9 @@ void ScopeDsymbol::importScope(Dsymbol *s, PROT protection)
         imports->push(s);
         prots = (PROT *)mem.realloc(prots, imports->dim * sizeof(prots[0]));
         prots[imports->dim - 1] = protection;
+#if IN_LLVM
+        searchGeneration++;
+#endif
     }
 }
 
@@ -1145,6 +1243,10 @@ const char *ScopeDsymbol::kind()
 
 Dsymbol *ScopeDsymbol::symtabInsert(Dsymbol *s)
 {
+#if IN_LLVM
+    if (isModule() || isNspace() || isTemplateMixin())
+        searchGeneration++;
+#endif
     return symtab->insert(s);
 }
 
@@ -1544,6 +1646,130 @@ Dsymbol *ArrayScopeSymbol::search(Loc loc, Identifier *ident, int flags)
 
 /****************************** DsymbolTable ******************************/
 
+#if IN_LLVM
+/* Counters for -v.
+ */
+static unsigned long long numLookups;
+static unsigned long long numProbes;
+static size_t maxProbes;
+static size_t numTables;
+static size_t numSlots;
+static size_t numSymbols;
+
+DsymbolTable::DsymbolTable()
+{
+    entries = NULL;
+    dim = 0;
+    count = 0;
+}
+
+/* Identifiers are interned, so their address is the key. Spread its bits by
+ * Fibonacci hashing.
+ */
+static inline size_t hashIdent(Identifier *ident)
+{
+    return (size_t)(((unsigned long long)(size_t)ident * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/* Returns the slot holding ident, or the empty slot where it belongs.
+ * The table must not be empty.
+ */
+DsymbolTable::Entry *DsymbolTable::find(Identifier *ident)
+{
+    const size_t mask = dim - 1;
+    size_t i = hashIdent(ident) & mask;
+    size_t probes = 1;
+    while (entries[i].ident && entries[i].ident != ident)
+    {
+        i = (i + 1) & mask;
+        probes++;
+    }
+    numLookups++;
+    numProbes += probes;
+    if (probes > maxProbes)
+        maxProbes = probes;
+    return &entries[i];
+}
+
+void DsymbolTable::grow()
+{
+    Entry *oentries = entries;
+    size_t odim = dim;
+
+    // Most tables are small, so start with a few slots only. Keep the load
+    // factor below 3/4.
+    dim = odim ? odim * 2 : 8;
+    entries = (Entry *)mem.calloc(dim, sizeof(Entry));
+    const size_t mask = dim - 1;
+    for (size_t i = 0; i < odim; i++)
+    {
+        if (!oentries[i].ident)
+            continue;
+        size_t j = hashIdent(oentries[i].ident) & mask;
+        while (entries[j].ident)
+            j = (j + 1) & mask;
+        entries[j] = oentries[i];
+    }
+    mem.free(oentries);
+
+    if (!odim)
+        numTables++;
+    numSlots += dim - odim;
+}
+
+Dsymbol *DsymbolTable::lookup(Identifier *ident)
+{
+    //printf("DsymbolTable::lookup(%s)\n", (char*)ident->string);
+    if (!count)
+        return NULL;
+    return find(ident)->s;
+}
+
+Dsymbol *DsymbolTable::insert(Dsymbol *s)
+{
+    //printf("DsymbolTable::insert(this = %p, '%s')\n", this, s->ident->toChars());
+    return insert(s->ident, s);
+}
+
+Dsymbol *DsymbolTable::insert(Identifier *ident, Dsymbol *s)
+{
+    //printf("DsymbolTable::insert()\n");
+    if ((count + 1) * 4 > dim * 3)
+        grow();
+    Entry *e = find(ident);
+    if (e->ident)
+        return NULL;            // already in table
+    e->ident = ident;
+    e->s = s;
+    count++;
+    numSymbols++;
+    return s;
+}
+
+Dsymbol *DsymbolTable::update(Dsymbol *s)
+{
+    Identifier *ident = s->ident;
+    if ((count + 1) * 4 > dim * 3)
+        grow();
+    Entry *e = find(ident);
+    if (!e->ident)
+    {
+        e->ident = ident;
+        count++;
+        numSymbols++;
+    }
+    e->s = s;
+    return s;
+}
+
+void DsymbolTable::printStatistics()
+{
+    fprintf(global.stdmsg, "symtab    %llu lookups, %.2f probes on average, %u at most\n",
+        numLookups, numLookups ? (double)numProbes / numLookups : 0.0, (unsigned)maxProbes);
+    fprintf(global.stdmsg, "symtab    %u tables, %u symbols in %u slots\n",
+        (unsigned)numTables, (unsigned)numSymbols, (unsigned)numSlots);
+}
+#else
 DsymbolTable::DsymbolTable()
 {
     tab = NULL;
@@ -1583,3 +1809,4 @@ Dsymbol *DsymbolTable::update(Dsymbol *s)
     *ps = s;
     return s;
 }
+#endif
@@ -316,6 +316,14 @@ public:
     ScopeDsymbol(Identifier *id);
     Dsymbol *syntaxCopy(Dsymbol *s);
     Dsymbol *search(Loc loc, Identifier *ident, int flags = IgnoreNone);
+#if IN_LLVM
+    Dsymbol *searchUncached(Loc loc, Identifier *ident, int flags);
+
+    // Bumped whenever the result of searching the imports of any scope may
+    // change, which invalidates the cached results.
+    static unsigned searchGeneration;
+    static void printSearchCacheStatistics();
+#endif
     OverloadSet *mergeOverloadSet(OverloadSet *os, Dsymbol *s);
     void importScope(Dsymbol *s, PROT protection);
     bool isforwardRef();
@@ -387,7 +395,19 @@ public:
 class DsymbolTable : public RootObject
 {
 public:
+#if IN_LLVM
+    struct Entry
+    {
+        Identifier *ident;      // NULL if the slot is empty
+        Dsymbol *s;
+    };
+
+    Entry *entries;             // open addressing, linear probing
+    size_t dim;                 // number of slots, 0 or a power of 2
+    size_t count;               // number of symbols
+#else
     AA *tab;
+#endif
 
     DsymbolTable();
 
@@ -400,6 +420,17 @@ public:
     // Look for Dsymbol in table. If there, return it. If not, insert s and return that.
     Dsymbol *update(Dsymbol *s);
     Dsymbol *insert(Identifier *ident, Dsymbol *s);     // when ident and s are not the same
+
+#if IN_LLVM
+    // Number of symbols in the table.
+    size_t len() { return count; }
+
+    static void printStatistics();
+
+private:
+    Entry *find(Identifier *ident);
+    void grow();
+#endif
 };
 
 #endif /* DMD_DSYMBOL_H */
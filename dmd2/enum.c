@@ -177,7 +177,11 @@ void EnumDeclaration::semantic(Scope *sc)
                 // memtype is forward referenced, so try again later
                 scope = scx ? scx : sc->copy();
                 scope->setNoFree();
+#if IN_LLVM
+                scope->module->addDeferredSemantic(this, sym);
+#else
                 scope->module->addDeferredSemantic(this);
+#endif
                 Module::dprogress = dprogress_save;
                 //printf("\tdeferring %s\n", toChars());
                 semanticRun = PASSinit;
@@ -3650,6 +3650,10 @@ StringExp::StringExp(Loc loc, char *string)
     this->committed = 0;
     this->postfix = 0;
     this->ownedByCtfe = false;
+#if IN_LLVM
+    this->ctfeBlock = NULL;
+    this->ctfePacked = false;
+#endif
 }
 
 StringExp::StringExp(Loc loc, void *string, size_t len)
@@ -3661,6 +3665,10 @@ StringExp::StringExp(Loc loc, void *string, size_t len)
     this->committed = 0;
     this->postfix = 0;
     this->ownedByCtfe = false;
+#if IN_LLVM
+    this->ctfeBlock = NULL;
+    this->ctfePacked = false;
+#endif
 }
 
 StringExp::StringExp(Loc loc, void *string, size_t len, utf8_t postfix)
@@ -3672,6 +3680,10 @@ StringExp::StringExp(Loc loc, void *string, size_t len, utf8_t postfix)
     this->committed = 0;
     this->postfix = postfix;
     this->ownedByCtfe = false;
+#if IN_LLVM
+    this->ctfeBlock = NULL;
+    this->ctfePacked = false;
+#endif
 }
 
 StringExp *StringExp::create(Loc loc, char *s)
@@ -5578,7 +5590,11 @@ void FuncExp::genIdent(Scope *sc)
             symtab = sds->symtab;
         }
         assert(symtab);
+#if IN_LLVM
+        int num = (int)symtab->len() + 1;
+#else
         int num = (int)dmd_aaLen(symtab->tab) + 1;
+#endif
         Identifier *id = Lexer::uniqueId(s, num);
         fd->ident = id;
         if (td) td->ident = id;
@@ -7002,6 +7018,9 @@ Expression *FileExp::semantic(Scope *sc)
 
     if (global.params.verbose)
         fprintf(global.stdmsg, "file      %s\t(%s)\n", (char *)se->string, name);
+#if IN_LLVM
+    sc->module->contentImportedFiles.push(name);
+#endif
     if (global.params.moduleDeps != NULL)
     {
         OutBuffer *ob = global.params.moduleDeps;
@@ -54,6 +54,7 @@ class SliceExp;
 #if IN_LLVM
 class AssignExp;
 class SymbolDeclaration;
+struct CtfeArrayBlock;
 #endif
 
 enum TOK;
@@ -427,6 +428,10 @@ public:
     unsigned char committed;    // !=0 if type is committed
     utf8_t postfix;      // 'c', 'w', 'd'
     bool ownedByCtfe;   // true = created in CTFE
+#if IN_LLVM
+    CtfeArrayBlock *ctfeBlock; // CTFE: spare capacity of string, if any
+    bool ctfePacked;    // CTFE: integral array the interpreter packed into a string
+#endif
 
     StringExp(Loc loc, char *s);
     StringExp(Loc loc, void *s, size_t len);
@@ -354,6 +354,7 @@ FuncDeclaration::FuncDeclaration(Loc loc, Loc endloc, Identifier *id, StorageCla
     isArrayOp = false;
     allowInlining = false;
     neverInline = false;
+    fbodyShared = false;
 #endif
 }
 
@@ -369,7 +370,11 @@ Dsymbol *FuncDeclaration::syntaxCopy(Dsymbol *s)
     f->outId = outId;
     f->frequire = frequire ? frequire->syntaxCopy() : NULL;
     f->fensure  = fensure  ? fensure->syntaxCopy()  : NULL;
+#if IN_LLVM
+    copyBodyTo(f);
+#else
     f->fbody    = fbody    ? fbody->syntaxCopy()    : NULL;
+#endif
     assert(!fthrows); // deprecated
 
 #if IN_LLVM
@@ -380,6 +385,38 @@ Dsymbol *FuncDeclaration::syntaxCopy(Dsymbol *s)
 }
 
 #if IN_LLVM
+/* The bodies of the functions in a template instance are only needed once
+ * semantic3() runs for them, which for many instances (e.g. speculative ones,
+ * or those only used for their types) never happens. So while the members of
+ * a template are copied for a new instance (shareBodies is set), the copies
+ * keep referring to the body of the template, which is never modified itself,
+ * and only make their own copy before the body is analyzed or changed.
+ */
+bool FuncDeclaration::shareBodies = false;
+
+void FuncDeclaration::copyBodyTo(FuncDeclaration *f)
+{
+    if (shareBodies && fbody)
+    {
+        f->fbody = fbody;
+        f->fbodyShared = true;
+    }
+    else
+    {
+        f->fbody = fbody ? fbody->syntaxCopy() : NULL;
+        f->fbodyShared = false;
+    }
+}
+
+void FuncDeclaration::unshareBody()
+{
+    if (fbodyShared)
+    {
+        fbody = fbody->syntaxCopy();
+        fbodyShared = false;
+    }
+}
+
 static int outToRefDg(void *ctx, size_t n, Parameter *p)
 {
     if (p->storageClass & STCout)
@@ -1303,6 +1340,9 @@ void FuncDeclaration::semantic3(Scope *sc)
         return;
     semanticRun = PASSsemantic3;
     semantic3Errors = false;
+#if IN_LLVM
+    unshareBody();
+#endif
 
     if (!type || type->ty != Tfunction)
         return;
@@ -3710,6 +3750,9 @@ void FuncDeclaration::appendExp(Expression *e)
 
 void FuncDeclaration::appendState(Statement *s)
 {
+#if IN_LLVM
+    unshareBody();
+#endif
     if (!fbody)
         fbody = s;
     else
@@ -4710,7 +4753,11 @@ Dsymbol *CtorDeclaration::syntaxCopy(Dsymbol *s)
     f->outId = outId;
     f->frequire = frequire ? frequire->syntaxCopy() : NULL;
     f->fensure  = fensure  ? fensure->syntaxCopy()  : NULL;
+#if IN_LLVM
+    copyBodyTo(f);
+#else
     f->fbody    = fbody    ? fbody->syntaxCopy()    : NULL;
+#endif
     assert(!fthrows); // deprecated
 
     return f;
@@ -5007,6 +5054,9 @@ void StaticCtorDeclaration::semantic(Scope *sc)
      */
     if (isInstantiated() && semanticRun < PASSsemantic)
     {
+#if IN_LLVM
+        unshareBody();
+#endif
         /* Add this prefix to the function:
          *      static int gate;
          *      if (++gate != 1) return;
@@ -5137,6 +5187,9 @@ void StaticDtorDeclaration::semantic(Scope *sc)
      */
     if (isInstantiated() && semanticRun < PASSsemantic)
     {
+#if IN_LLVM
+        unshareBody();
+#endif
         /* Add this prefix to the function:
          *      static int gate;
          *      if (--gate != 0) return;
@@ -32,6 +32,10 @@
 #include "template.h"
 #include "port.h"
 #include "ctfe.h"
+#if IN_LLVM
+#include <time.h>
+#include "json.h"
+#endif
 
 bool walkPostorder(Expression *e, StoppableVisitor *v);
 
@@ -43,6 +47,13 @@ bool walkPostorder(Expression *e, StoppableVisitor *v);
 // Maximum allowable recursive function calls in CTFE
 #define CTFE_RECURSION_LIMIT 1000
 
+#if IN_LLVM
+// Maximum estimated number of bytes kept by the memoized results of pure calls
+#define CTFE_MEMO_LIMIT (64 * 1024 * 1024)
+// Maximum estimated number of bytes of the arguments of a memoized call
+#define CTFE_MEMO_ARGS_LIMIT (64 * 1024)
+#endif
+
 /**
   The values of all CTFE variables
 */
@@ -246,6 +257,15 @@ int CtfeStatus::stackTraceCallsToSuppress = 0;
 int CtfeStatus::maxCallDepth = 0;
 int CtfeStatus::numArrayAllocs = 0;
 int CtfeStatus::numAssignments = 0;
+#if IN_LLVM
+int CtfeStatus::numBytecodeFunctions = 0;
+int CtfeStatus::numBytecodeCalls = 0;
+int CtfeStatus::numBytecodeFallbacks = 0;
+int CtfeStatus::numPackedArrays = 0;
+int CtfeStatus::numArrayAppendsInPlace = 0;
+int CtfeStatus::numMemoHits = 0;
+int CtfeStatus::numMemoMisses = 0;
+#endif
 
 // CTFE diagnostic information
 void printCtfePerformanceStats()
@@ -255,6 +275,20 @@ void printCtfePerformanceStats()
     printf("max call depth = %d\tmax stack = %d\n", CtfeStatus::maxCallDepth, ctfeStack.maxStackUsage());
     printf("array allocs = %d\tassignments = %d\n\n", CtfeStatus::numArrayAllocs, CtfeStatus::numAssignments);
 #endif
+#if IN_LLVM
+    fprintf(global.stdmsg, "ctfe      %d calls run as bytecode (%d functions), %d given back to the interpreter\n",
+        CtfeStatus::numBytecodeCalls, CtfeStatus::numBytecodeFunctions, CtfeStatus::numBytecodeFallbacks);
+    fprintf(global.stdmsg, "ctfe      %d array allocations, %d packed arrays, %d appends in place\n",
+        CtfeStatus::numArrayAllocs, CtfeStatus::numPackedArrays, CtfeStatus::numArrayAppendsInPlace);
+    fprintf(global.stdmsg, "ctfe      %d pure calls reused memoized results, %d evaluated\n",
+        CtfeStatus::numMemoHits, CtfeStatus::numMemoMisses);
+    if (global.params.ctfeArena)
+    {
+        fprintf(global.stdmsg, "ctfe      %d arenas released (%llu KB), %d kept\n",
+            CtfeArena::numReleased, (unsigned long long)(CtfeArena::bytesReleased / 1024),
+            CtfeArena::numKept);
+    }
+#endif
 }
 
 VarDeclaration *findParentVar(Expression *e);
@@ -269,16 +303,31 @@ Expression *scrubReturnValue(Loc loc, Expression *e);
  *
  * Currently only counts the number of local variables in the function
  */
+#if IN_LLVM
+struct CtfeBytecode;
+struct CtfeProfile;
+#endif
+
 struct CompiledCtfeFunction
 {
     FuncDeclaration *func; // Function being compiled, NULL if global scope
     int numVars;           // Number of variables declared in this function
     Loc callingloc;
+#if IN_LLVM
+    CtfeBytecode *bytecode; // NULL if the function cannot be run as bytecode
+    bool bytecodeDone;      // true if bytecode has been determined
+    CtfeProfile *profile;   // -vctfe-profile statistics by site, NULL if none
+#endif
 
     CompiledCtfeFunction(FuncDeclaration *f)
     {
         func = f;
         numVars = 0;
+#if IN_LLVM
+        bytecode = NULL;
+        bytecodeDone = false;
+        profile = NULL;
+#endif
     }
 
     void onDeclaration(VarDeclaration *v)
@@ -575,152 +624,1787 @@ public:
     #endif
     }
 
-    void visit(WithStatement *s)
+    void visit(WithStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s WithStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        // If it is with(Enum) {...}, just execute the body.
+        if (s->exp->op == TOKimport || s->exp->op == TOKtype)
+        {
+        }
+        else
+        {
+            ccf->onDeclaration(s->wthis);
+            ccf->onExpression(s->exp);
+        }
+        if (s->body)
+            ctfeCompile(s->body);
+    }
+
+    void visit(TryCatchStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s TryCatchStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        if (s->body)
+            ctfeCompile(s->body);
+        for (size_t i = 0; i < s->catches->dim; i++)
+        {
+            Catch *ca = (*s->catches)[i];
+            if (ca->var)
+                ccf->onDeclaration(ca->var);
+            if (ca->handler)
+                ctfeCompile(ca->handler);
+        }
+    }
+
+    void visit(TryFinallyStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s TryFinallyStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        if (s->body)
+            ctfeCompile(s->body);
+        if (s->finalbody)
+            ctfeCompile(s->finalbody);
+    }
+
+    void visit(ThrowStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s ThrowStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        ccf->onExpression(s->exp);
+    }
+
+    void visit(GotoStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s GotoStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+    }
+
+    void visit(LabelStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s LabelStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        if (s->statement)
+            ctfeCompile(s->statement);
+    }
+
+    void visit(ImportStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s ImportStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        // Contains no variables or executable code
+    }
+
+    void visit(ForeachRangeStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s ForeachRangeStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        // rewritten for ForStatement
+        assert(0);
+    }
+
+    void visit(AsmStatement *s)
+    {
+    #if LOGCOMPILE
+        printf("%s AsmStatement::ctfeCompile\n", s->loc.toChars());
+    #endif
+        // we can't compile asm statements
+    }
+
+#if IN_LLVM
+    void visit(AsmBlockStatement *s)
+    {
+#if LOGCOMPILE
+        printf("%s AsmBlockStatement::ctfeCompile\n", s->loc.toChars());
+#endif
+        // we can't compile asm statements
+    }
+#endif
+
+    void ctfeCompile(Statement *s)
+    {
+        s->accept(this);
+    }
+};
+
+/*************************************
+ * Compile this function for CTFE.
+ * At present, this merely allocates variables.
+ */
+void ctfeCompile(FuncDeclaration *fd)
+{
+#if LOGCOMPILE
+    printf("\n%s FuncDeclaration::ctfeCompile %s\n", fd->loc.toChars(), fd->toChars());
+#endif
+    assert(!fd->ctfeCode);
+    assert(!fd->semantic3Errors);
+    assert(fd->semanticRun == PASSsemantic3done);
+
+    fd->ctfeCode = new CompiledCtfeFunction(fd);
+    if (fd->parameters)
+    {
+        Type *tb = fd->type->toBasetype();
+        assert(tb->ty == Tfunction);
+        for (size_t i = 0; i < fd->parameters->dim; i++)
+        {
+            VarDeclaration *v = (*fd->parameters)[i];
+            fd->ctfeCode->onDeclaration(v);
+        }
+    }
+    if (fd->vresult)
+        fd->ctfeCode->onDeclaration(fd->vresult);
+    CtfeCompiler v(fd->ctfeCode);
+    v.ctfeCompile(fd->fbody);
+}
+
+#if IN_LLVM
+/*************************************
+ * Bytecode for CTFE
+ *
+ * Functions which only compute with integral and floating point values and
+ * read dynamic arrays of those (arithmetic, comparisons, casts, if/for/do,
+ * foreach over arrays, local variables and calls to other such functions) are
+ * lowered once into a register bytecode, which is cached in their
+ * CompiledCtfeFunction. Every value is kept unboxed in a slot of the frame,
+ * so running the bytecode creates no expressions at all. Arrays are only
+ * read, so a slot just refers to the array literal the interpreter passed in.
+ *
+ * Everything else is left to the interpreter. If the bytecode runs into
+ * anything it cannot deal with (a division by zero, an array index out of
+ * bounds, a callee which cannot be compiled, the recursion limit, ...), the
+ * call is simply repeated by the interpreter, which then reports the error.
+ * This is possible because the bytecode cannot have any side effects outside
+ * of its own frames.
+ *
+ * Floating point values are computed with real_t precision, like the
+ * interpreter does in constfold.c.
+ */
+
+enum CtfeOpcode
+{
+    BCconst,                                    // dst = imm
+    BCfconst,                                   // dst = fconsts[imm]
+    BCmove,                                     // dst = a
+    BCadd, BCsub, BCmul, BCdiv, BCmod,          // dst = a op b
+    BCand, BCor, BCxor, BCshl, BCshr, BCushr,
+    BCneg, BCcom, BCnot,                        // dst = op a
+    BCeq, BCne, BClt, BCle, BCgt, BCge,         // dst = a op b
+    BCfadd, BCfsub, BCfmul, BCfdiv, BCfmod,     // dst = a op b, floating point
+    BCfneg,                                     // dst = -a, floating point
+    BCfeq, BCfne, BCflt, BCfle, BCfgt, BCfge,   // dst = a op b, floating point
+    BCitof,                                     // dst = (real_t)a
+    BCftoi,                                     // dst = (ty)a
+    BClength,                                   // dst = a.length
+    BCindex,                                    // dst = a[b]
+    BCjmp,                                      // goto imm
+    BCjz,                                       // if (!a) goto imm
+    BCjnz,                                      // if (a) goto imm
+    BCcall,                                     // dst = callees[imm](b args at a)
+    BCret,                                      // return a
+    BCbail                                      // let the interpreter do it
+};
+
+struct CtfeInsn
+{
+    unsigned char op;
+    unsigned char ty;           // type the result is truncated to
+    unsigned char opty;         // type of a, for shifts and conversions
+    unsigned char isunsigned;   // for divisions and comparisons
+    int dst;
+    int a;
+    int b;
+    dinteger_t imm;
+};
+
+// The value of a slot
+union CtfeValue
+{
+    dinteger_t i;               // integral types
+    real_t f;                   // floating point types
+    Expression *e;              // dynamic arrays, as passed by the interpreter
+};
+
+struct CtfeBytecode
+{
+    Array<CtfeInsn> code;
+    Array<real_t> fconsts;
+    Array<FuncDeclaration *> callees;
+    Array<CtfeBytecode *> calleeCode;   // resolved by the first call
+    size_t numParams;
+    size_t frameSize;
+    bool disabled;                      // calls something the bytecode can't
+
+    CtfeBytecode()
+    {
+        numParams = 0;
+        frameSize = 0;
+        disabled = false;
+    }
+};
+
+/* Return the type values of type t are stored as, or Terror if they are not
+ * supported by the bytecode.
+ */
+static TY bytecodeTy(Type *t)
+{
+    if (!t)
+        return Terror;
+    t = t->toBasetype();
+    switch (t->ty)
+    {
+        case Tbool:
+        case Tint8:  case Tuns8:  case Tchar:
+        case Tint16: case Tuns16: case Twchar:
+        case Tint32: case Tuns32: case Tdchar:
+        case Tint64: case Tuns64:
+        case Tfloat32: case Tfloat64: case Tfloat80:
+            return t->ty;
+        default:
+            return Terror;
+    }
+}
+
+/* Same as bytecodeTy(), but also accepts the dynamic arrays the bytecode can
+ * read, as Tarray. Those can only be stored and passed on.
+ */
+static TY bytecodeSlotTy(Type *t)
+{
+    if (t && t->toBasetype()->ty == Tarray)
+        return bytecodeTy(t->toBasetype()->nextOf()) == Terror ? Terror : Tarray;
+    return bytecodeTy(t);
+}
+
+static bool bytecodeIsFloat(unsigned ty)
+{
+    return ty == Tfloat32 || ty == Tfloat64 || ty == Tfloat80;
+}
+
+// Same as IntegerExp::normalize()
+static dinteger_t bytecodeNormalize(dinteger_t value, unsigned ty)
+{
+    switch (ty)
+    {
+        case Tbool:         return value != 0;
+        case Tint8:         return (d_int8)  value;
+        case Tchar:
+        case Tuns8:         return (d_uns8)  value;
+        case Tint16:        return (d_int16) value;
+        case Twchar:
+        case Tuns16:        return (d_uns16) value;
+        case Tint32:        return (d_int32) value;
+        case Tdchar:
+        case Tuns32:        return (d_uns32) value;
+        default:            return value;
+    }
+}
+
+// Same as the conversion in constfold.c Cast()
+static dinteger_t bytecodeRealToInteger(real_t r, unsigned ty)
+{
+    switch (ty)
+    {
+        case Tbool:         return (sinteger_t)r != 0;
+        case Tint8:         return (d_int8)r;
+        case Tchar:
+        case Tuns8:         return (d_uns8)r;
+        case Tint16:        return (d_int16)r;
+        case Twchar:
+        case Tuns16:        return (d_uns16)r;
+        case Tint32:        return (d_int32)r;
+        case Tdchar:
+        case Tuns32:        return (d_uns32)r;
+        case Tint64:        return (d_int64)r;
+        default:            return (d_uns64)r;
+    }
+}
+
+static unsigned bytecodeBits(unsigned ty)
+{
+    switch (ty)
+    {
+        case Tbool: case Tint8: case Tuns8: case Tchar:     return 8;
+        case Tint16: case Tuns16: case Twchar:              return 16;
+        case Tint32: case Tuns32: case Tdchar:              return 32;
+        default:                                            return 64;
+    }
+}
+
+static bool bytecodeIsSigned(unsigned ty)
+{
+    return ty == Tint8 || ty == Tint16 || ty == Tint32 || ty == Tint64;
+}
+
+class CtfeBytecodeCompiler : public Visitor
+{
+public:
+    FuncDeclaration *fd;
+    CtfeBytecode *bc;
+    bool ok;
+    int result;                         // slot holding the value of an expression
+    Array<VarDeclaration *> slotVars;   // the variable of each slot, NULL for temporaries
+    Array<size_t> *breaks;              // jumps to patch at the end of the loop
+    Array<size_t> *continues;
+
+    CtfeBytecodeCompiler(FuncDeclaration *fd, CtfeBytecode *bc)
+        : fd(fd), bc(bc)
+    {
+        ok = true;
+        result = 0;
+        breaks = NULL;
+        continues = NULL;
+    }
+
+    int newSlot(VarDeclaration *v)
+    {
+        slotVars.push(v);
+        return (int)slotVars.dim - 1;
+    }
+
+    int varSlot(VarDeclaration *v)
+    {
+        for (size_t i = 0; i < slotVars.dim; i++)
+        {
+            if (slotVars[i] == v)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    size_t emit(int op, TY ty, int dst, int a = 0, int b = 0, dinteger_t imm = 0)
+    {
+        CtfeInsn in;
+        memset(&in, 0, sizeof(in));
+        in.op = (unsigned char)op;
+        in.ty = (unsigned char)ty;
+        in.dst = dst;
+        in.a = a;
+        in.b = b;
+        in.imm = imm;
+        bc->code.push(in);
+        return bc->code.dim - 1;
+    }
+
+    void patch(size_t jump)
+    {
+        bc->code[jump].imm = bc->code.dim;
+    }
+
+    void fail()
+    {
+        ok = false;
+        result = 0;
+    }
+
+    /* Compile e, and return the slot its value ends up in. If a variable is
+     * read whose value might still be changed by later, an expression
+     * evaluated before the value is used, it is copied first.
+     */
+    int value(Expression *e, Expression *later = NULL)
+    {
+        if (!ok)
+            return 0;
+        e->accept(this);
+        if (!ok)
+            return 0;
+        int r = result;
+        if (later && slotVars[r] && later->op != TOKint64 && later->op != TOKvar)
+        {
+            int t = newSlot(NULL);
+            emit(BCmove, bytecodeSlotTy(e->type), t, r);
+            r = t;
+        }
+        return r;
+    }
+
+    /* Compile a condition, which has to be integral: the truth of floating
+     * point values is left to the interpreter.
+     */
+    int condition(Expression *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        if (ty == Terror || bytecodeIsFloat(ty))
+        {
+            fail();
+            return 0;
+        }
+        return value(e);
+    }
+
+    /* Return true if a value of type from can be moved to a slot of type to
+     * as is, i.e. without a conversion between integral and floating point.
+     */
+    static bool sameKind(TY to, TY from)
+    {
+        if (to == Terror || from == Terror)
+            return false;
+        if (to == Tarray || from == Tarray)
+            return to == from;
+        return bytecodeIsFloat(to) == bytecodeIsFloat(from);
+    }
+
+    void statement(Statement *s)
+    {
+        if (ok && s)
+            s->accept(this);
+    }
+
+    // Return the slot of the local variable e refers to, or -1.
+    int lvalue(Expression *e)
+    {
+        if (e->op != TOKvar)
+            return -1;
+        VarDeclaration *v = ((VarExp *)e)->var->isVarDeclaration();
+        return v ? varSlot(v) : -1;
+    }
+
+    /* Statements
+     */
+
+    void visit(Statement *s)
+    {
+        fail();
+    }
+
+    void visit(ExpStatement *s)
+    {
+        if (s->exp)
+            value(s->exp);
+    }
+
+    void visit(DtorExpStatement *s)
+    {
+        fail();
+    }
+
+    void visit(CompoundStatement *s)
+    {
+        for (size_t i = 0; i < s->statements->dim; i++)
+            statement((*s->statements)[i]);
+    }
+
+    void visit(ScopeStatement *s)
+    {
+        statement(s->statement);
+    }
+
+    void visit(ImportStatement *s)
+    {
+    }
+
+    void visit(IfStatement *s)
+    {
+        if (s->match)
+        {
+            fail();
+            return;
+        }
+        int c = condition(s->condition);
+        size_t jelse = emit(BCjz, Tbool, 0, c);
+        statement(s->ifbody);
+        if (s->elsebody)
+        {
+            size_t jend = emit(BCjmp, Tbool, 0);
+            patch(jelse);
+            statement(s->elsebody);
+            patch(jend);
+        }
+        else
+            patch(jelse);
+    }
+
+    void loopBody(Statement *body, Array<size_t> *brk, Array<size_t> *cont)
+    {
+        Array<size_t> *oldbreaks = breaks;
+        Array<size_t> *oldcontinues = continues;
+        breaks = brk;
+        continues = cont;
+        statement(body);
+        breaks = oldbreaks;
+        continues = oldcontinues;
+    }
+
+    void patchAll(Array<size_t> &jumps)
+    {
+        for (size_t i = 0; i < jumps.dim; i++)
+            patch(jumps[i]);
+    }
+
+    void visit(ForStatement *s)
+    {
+        statement(s->init);
+        Array<size_t> brk;
+        Array<size_t> cont;
+        size_t top = bc->code.dim;
+        if (s->condition)
+        {
+            int c = condition(s->condition);
+            brk.push(emit(BCjz, Tbool, 0, c));
+        }
+        loopBody(s->body, &brk, &cont);
+        patchAll(cont);
+        if (s->increment)
+            value(s->increment);
+        emit(BCjmp, Tbool, 0, 0, 0, top);
+        patchAll(brk);
+    }
+
+    void visit(DoStatement *s)
+    {
+        Array<size_t> brk;
+        Array<size_t> cont;
+        size_t top = bc->code.dim;
+        loopBody(s->body, &brk, &cont);
+        patchAll(cont);
+        int c = condition(s->condition);
+        emit(BCjnz, Tbool, 0, c, 0, top);
+        patchAll(brk);
+    }
+
+    void visit(BreakStatement *s)
+    {
+        if (s->ident || !breaks)
+        {
+            fail();
+            return;
+        }
+        breaks->push(emit(BCjmp, Tbool, 0));
+    }
+
+    void visit(ContinueStatement *s)
+    {
+        if (s->ident || !continues)
+        {
+            fail();
+            return;
+        }
+        continues->push(emit(BCjmp, Tbool, 0));
+    }
+
+    void visit(ReturnStatement *s)
+    {
+        TypeFunction *tf = (TypeFunction *)fd->type->toBasetype();
+        TY ty = bytecodeTy(tf->next);
+        if (!s->exp || !sameKind(ty, bytecodeSlotTy(s->exp->type)))
+        {
+            fail();
+            return;
+        }
+        int r = value(s->exp);
+        emit(BCret, ty, 0, r);
+    }
+
+    /* Expressions
+     */
+
+    void visit(Expression *e)
+    {
+        fail();
+    }
+
+    void visit(IntegerExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        if (ty == Terror || bytecodeIsFloat(ty))
+        {
+            fail();
+            return;
+        }
+        result = newSlot(NULL);
+        emit(BCconst, ty, result, 0, 0, bytecodeNormalize(e->getInteger(), ty));
+    }
+
+    void visit(RealExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        if (!bytecodeIsFloat(ty))
+        {
+            fail();
+            return;
+        }
+        result = newSlot(NULL);
+        emit(BCfconst, ty, result, 0, 0, bc->fconsts.dim);
+        bc->fconsts.push(e->toReal());
+    }
+
+    void visit(VarExp *e)
+    {
+        result = lvalue(e);
+        if (result < 0)
+            fail();
+    }
+
+    void visit(DeclarationExp *e)
+    {
+        VarDeclaration *v = e->declaration->isVarDeclaration();
+        if (v && (v->storage_class & STCmanifest))
+        {
+            // Only used by constant folding
+            result = newSlot(NULL);
+            return;
+        }
+        if (!v || v->toAlias() != v || v->isDataseg() ||
+            (v->storage_class & (STCref | STCout | STClazy)) ||
+            bytecodeSlotTy(v->type) == Terror || !v->init)
+        {
+            fail();
+            return;
+        }
+        ExpInitializer *ie = v->init->isExpInitializer();
+        if (!ie || (ie->exp->op != TOKconstruct && ie->exp->op != TOKblit &&
+                    ie->exp->op != TOKassign))
+        {
+            fail();
+            return;
+        }
+        newSlot(v);
+        value(ie->exp);
+    }
+
+    void visit(AssignExp *e)
+    {
+        int v = lvalue(e->e1);
+        TY ty = bytecodeSlotTy(e->e1->type);
+        if (v < 0 || !sameKind(ty, bytecodeSlotTy(e->e2->type)))
+        {
+            fail();
+            return;
+        }
+        int r = value(e->e2);
+        emit(BCmove, ty, v, r);
+        result = v;
+    }
+
+    /* Return the opcode for the arithmetic operation op, or -1.
+     */
+    static int arithmeticOp(TOK op, bool isfloat)
+    {
+        switch (op)
+        {
+            case TOKadd:    case TOKaddass:     return isfloat ? BCfadd : BCadd;
+            case TOKmin:    case TOKminass:     return isfloat ? BCfsub : BCsub;
+            case TOKmul:    case TOKmulass:     return isfloat ? BCfmul : BCmul;
+            case TOKdiv:    case TOKdivass:     return isfloat ? BCfdiv : BCdiv;
+            case TOKmod:    case TOKmodass:     return isfloat ? BCfmod : BCmod;
+            default:                            break;
+        }
+        if (isfloat)
+            return -1;
+        switch (op)
+        {
+            case TOKand:    case TOKandass:     return BCand;
+            case TOKor:     case TOKorass:      return BCor;
+            case TOKxor:    case TOKxorass:     return BCxor;
+            case TOKshl:    case TOKshlass:     return BCshl;
+            case TOKshr:    case TOKshrass:     return BCshr;
+            case TOKushr:   case TOKushrass:    return BCushr;
+            default:                            return -1;
+        }
+    }
+
+    void visit(BinAssignExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        TY ty1 = bytecodeTy(e->e1->type);
+        TY ty2 = bytecodeTy(e->e2->type);
+        int v = lvalue(e->e1);
+        if (v < 0 || !sameKind(ty, ty1) || !sameKind(ty, ty2))
+        {
+            fail();
+            return;
+        }
+        int op = arithmeticOp(e->op, bytecodeIsFloat(ty));
+        if (op < 0)
+        {
+            fail();
+            return;
+        }
+        // The right hand side is evaluated before the variable is read
+        int r = value(e->e2);
+        size_t i = emit(op, ty, v, v, r);
+        bc->code[i].opty = ty1;
+        bc->code[i].isunsigned = e->e1->type->isunsigned() || e->e2->type->isunsigned();
+        if (ty != ty1)
+            emit(BCmove, ty1, v, v);
+        result = v;
+    }
+
+    void visit(PostExp *e)
+    {
+        int v = lvalue(e->e1);
+        TY ty = bytecodeTy(e->type);
+        if (v < 0 || ty == Terror || bytecodeIsFloat(ty) || bytecodeTy(e->e1->type) != ty ||
+            !sameKind(ty, bytecodeTy(e->e2->type)))
+        {
+            fail();
+            return;
+        }
+        result = newSlot(NULL);
+        emit(BCmove, ty, result, v);
+        int r = value(e->e2);
+        emit(e->op == TOKplusplus ? BCadd : BCsub, ty, v, v, r);
+    }
+
+    void visit(BinExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        TY ty1 = bytecodeTy(e->e1->type);
+        TY ty2 = bytecodeTy(e->e2->type);
+        if (ty == Terror || !sameKind(ty1, ty2))
+        {
+            fail();
+            return;
+        }
+        bool isfloat = bytecodeIsFloat(ty1);
+        int op = arithmeticOp(e->op, isfloat);
+        if (op >= 0 && !sameKind(ty, ty1))
+            op = -1;
+        if (op < 0 && !bytecodeIsFloat(ty))
+        {
+            switch (e->op)
+            {
+                case TOKequal:          op = isfloat ? BCfeq : BCeq; break;
+                case TOKnotequal:       op = isfloat ? BCfne : BCne; break;
+                case TOKlt:             op = isfloat ? BCflt : BClt; break;
+                case TOKle:             op = isfloat ? BCfle : BCle; break;
+                case TOKgt:             op = isfloat ? BCfgt : BCgt; break;
+                case TOKge:             op = isfloat ? BCfge : BCge; break;
+                case TOKidentity:       op = isfloat ? -1 : BCeq; break;
+                case TOKnotidentity:    op = isfloat ? -1 : BCne; break;
+                default:                break;
+            }
+        }
+        if (op < 0)
+        {
+            fail();
+            return;
+        }
+        int a = value(e->e1, e->e2);
+        int b = value(e->e2);
+        result = newSlot(NULL);
+        size_t i = emit(op, ty, result, a, b);
+        bc->code[i].opty = ty1;
+        bc->code[i].isunsigned = e->e1->type->isunsigned() || e->e2->type->isunsigned();
+    }
+
+    void visit(AndAndExp *e)
+    {
+        if (bytecodeTy(e->type) == Terror)
+        {
+            fail();
+            return;
+        }
+        int r = newSlot(NULL);
+        emit(BCmove, Tbool, r, condition(e->e1));
+        size_t jend = emit(BCjz, Tbool, 0, r);
+        emit(BCmove, Tbool, r, condition(e->e2));
+        patch(jend);
+        result = r;
+    }
+
+    void visit(OrOrExp *e)
+    {
+        if (bytecodeTy(e->type) == Terror)
+        {
+            fail();
+            return;
+        }
+        int r = newSlot(NULL);
+        emit(BCmove, Tbool, r, condition(e->e1));
+        size_t jend = emit(BCjnz, Tbool, 0, r);
+        emit(BCmove, Tbool, r, condition(e->e2));
+        patch(jend);
+        result = r;
+    }
+
+    void visit(CondExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        if (!sameKind(ty, bytecodeTy(e->e1->type)) || !sameKind(ty, bytecodeTy(e->e2->type)))
+        {
+            fail();
+            return;
+        }
+        int r = newSlot(NULL);
+        int c = condition(e->econd);
+        size_t jelse = emit(BCjz, Tbool, 0, c);
+        emit(BCmove, ty, r, value(e->e1));
+        size_t jend = emit(BCjmp, Tbool, 0);
+        patch(jelse);
+        emit(BCmove, ty, r, value(e->e2));
+        patch(jend);
+        result = r;
+    }
+
+    void visit(CommaExp *e)
+    {
+        value(e->e1);
+        result = value(e->e2);
+    }
+
+    void visit(UnaExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        TY ty1 = bytecodeTy(e->e1->type);
+        if (!sameKind(ty, ty1))
+        {
+            fail();
+            return;
+        }
+        int op = -1;
+        switch (e->op)
+        {
+            case TOKneg:    op = bytecodeIsFloat(ty) ? BCfneg : BCneg; break;
+            case TOKtilde:  op = bytecodeIsFloat(ty) ? -1 : BCcom; break;
+            case TOKnot:    op = bytecodeIsFloat(ty) ? -1 : BCnot; break;
+            default:        break;
+        }
+        if (op < 0)
+        {
+            fail();
+            return;
+        }
+        int a = value(e->e1);
+        result = newSlot(NULL);
+        emit(op, ty, result, a);
+    }
+
+    void visit(CastExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        TY ty1 = bytecodeTy(e->e1->type);
+        if (ty == Terror || ty1 == Terror)
+        {
+            fail();
+            return;
+        }
+        int op = BCmove;
+        if (bytecodeIsFloat(ty) && !bytecodeIsFloat(ty1))
+            op = BCitof;
+        else if (!bytecodeIsFloat(ty) && bytecodeIsFloat(ty1))
+            op = BCftoi;
+        int a = value(e->e1);
+        result = newSlot(NULL);
+        size_t i = emit(op, ty, result, a);
+        bc->code[i].opty = ty1;
+    }
+
+    void visit(ArrayLengthExp *e)
+    {
+        if (bytecodeSlotTy(e->e1->type) != Tarray || bytecodeTy(e->type) == Terror)
+        {
+            fail();
+            return;
+        }
+        int a = value(e->e1);
+        result = newSlot(NULL);
+        emit(BClength, bytecodeTy(e->type), result, a);
+    }
+
+    void visit(IndexExp *e)
+    {
+        TY ty = bytecodeTy(e->type);
+        TY ty2 = bytecodeTy(e->e2->type);
+        if (bytecodeSlotTy(e->e1->type) != Tarray || ty == Terror ||
+            ty2 == Terror || bytecodeIsFloat(ty2))
+        {
+            fail();
+            return;
+        }
+        int a = value(e->e1, e->e2);
+        int b = value(e->e2);
+        result = newSlot(NULL);
+        emit(BCindex, ty, result, a, b);
+    }
+
+    void visit(SliceExp *e)
+    {
+        // Only a[], as in the lowering of foreach
+        if (e->lwr || e->upr || bytecodeSlotTy(e->type) != Tarray ||
+            bytecodeSlotTy(e->e1->type) != Tarray)
+        {
+            fail();
+            return;
+        }
+        result = value(e->e1);
+    }
+
+    void visit(CallExp *e)
+    {
+        FuncDeclaration *f = e->e1->op == TOKvar ? ((VarExp *)e->e1)->var->isFuncDeclaration() : NULL;
+        if (!f || !f->fbody || f->needThis() || f->isNested() || isBuiltin(f) == BUILTINyes ||
+            !f->type || f->type->toBasetype()->ty != Tfunction)
+        {
+            fail();
+            return;
+        }
+        TypeFunction *tf = (TypeFunction *)f->type->toBasetype();
+        size_t nargs = e->arguments ? e->arguments->dim : 0;
+        if (tf->varargs || tf->isref || bytecodeTy(tf->next) == Terror ||
+            Parameter::dim(tf->parameters) != nargs)
+        {
+            fail();
+            return;
+        }
+        for (size_t i = 0; i < nargs; i++)
+        {
+            Parameter *p = Parameter::getNth(tf->parameters, i);
+            if ((p->storageClass & (STCref | STCout | STClazy)) ||
+                !sameKind(bytecodeSlotTy(p->type), bytecodeSlotTy((*e->arguments)[i]->type)))
+            {
+                fail();
+                return;
+            }
+        }
+
+        // The arguments go into consecutive slots, in the order they are
+        // evaluated.
+        int base = (int)slotVars.dim;
+        for (size_t i = 0; i < nargs; i++)
+            newSlot(NULL);
+        for (size_t i = 0; i < nargs; i++)
+        {
+            Parameter *p = Parameter::getNth(tf->parameters, i);
+            emit(BCmove, bytecodeSlotTy(p->type), base + (int)i, value((*e->arguments)[i]));
+        }
+
+        size_t index = bc->callees.dim;
+        for (size_t i = 0; i < bc->callees.dim; i++)
+        {
+            if (bc->callees[i] == f)
+                index = i;
+        }
+        if (index == bc->callees.dim)
+        {
+            bc->callees.push(f);
+            bc->calleeCode.push(NULL);
+        }
+        result = newSlot(NULL);
+        emit(BCcall, bytecodeTy(tf->next), result, base, (int)nargs, index);
+    }
+};
+
+/* Compile fd to bytecode, or return NULL if it uses anything the bytecode
+ * does not support.
+ */
+static CtfeBytecode *compileBytecode(FuncDeclaration *fd)
+{
+    TypeFunction *tf = (TypeFunction *)fd->type->toBasetype();
+    if (!fd->fbody || fd->needThis() || fd->isNested() || fd->vresult ||
+        tf->varargs || tf->isref || bytecodeTy(tf->next) == Terror)
+        return NULL;
+
+    CtfeBytecode *bc = new CtfeBytecode();
+    CtfeBytecodeCompiler v(fd, bc);
+    size_t nparams = fd->parameters ? fd->parameters->dim : 0;
+    for (size_t i = 0; i < nparams; i++)
+    {
+        VarDeclaration *p = (*fd->parameters)[i];
+        if ((p->storage_class & (STCref | STCout | STClazy)) ||
+            bytecodeSlotTy(p->type) == Terror)
+            return NULL;
+        v.newSlot(p);
+    }
+    v.statement(fd->fbody);
+    if (!v.ok)
+        return NULL;
+
+    // Falling off the end of the function is an error
+    v.emit(BCbail, Tbool, 0);
+    bc->numParams = nparams;
+    bc->frameSize = v.slotVars.dim;
+    return bc;
+}
+
+/* Return the bytecode for fd, or NULL if fd cannot be run as bytecode right
+ * now. Does the same checks as interpret() before a function is run.
+ */
+static CtfeBytecode *getBytecode(FuncDeclaration *fd)
+{
+    if (fd->semanticRun == PASSsemantic3 || !fd->functionSemantic3() ||
+        fd->semanticRun < PASSsemantic3done || fd->semantic3Errors || !fd->fbody)
+        return NULL;
+    if (!fd->ctfeCode)
+        ctfeCompile(fd);
+    CompiledCtfeFunction *ccf = fd->ctfeCode;
+    if (!ccf->bytecodeDone)
+    {
+        ccf->bytecode = compileBytecode(fd);
+        ccf->bytecodeDone = true;
+        if (ccf->bytecode)
+            ++CtfeStatus::numBytecodeFunctions;
+    }
+    if (ccf->bytecode && ccf->bytecode->disabled)
+        return NULL;
+    return ccf->bytecode;
+}
+
+/* Return true if fd can never be run as bytecode, as opposed to not right
+ * now, e.g. because its semantic3 is still in progress.
+ */
+static bool noBytecode(FuncDeclaration *fd)
+{
+    CompiledCtfeFunction *ccf = fd->ctfeCode;
+    return ccf && ccf->bytecodeDone && (!ccf->bytecode || ccf->bytecode->disabled);
+}
+
+/* Get the array literal and the bounds of the elements the array value e
+ * refers to. Return false if it is not something the bytecode can read.
+ */
+static bool bytecodeArray(Expression *e, Expression **pbase, size_t *plwr, size_t *plen)
+{
+    *pbase = NULL;
+    *plwr = 0;
+    *plen = 0;
+    if (!e || e->op == TOKnull)
+        return true;
+
+    size_t lwr = 0;
+    size_t upr = ~(size_t)0;
+    if (e->op == TOKslice)
+    {
+        SliceExp *se = (SliceExp *)e;
+        if (!se->lwr || !se->upr || se->lwr->op != TOKint64 || se->upr->op != TOKint64)
+            return false;
+        lwr = (size_t)se->lwr->toInteger();
+        upr = (size_t)se->upr->toInteger();
+        e = se->e1;
+    }
+
+    size_t dim;
+    if (e->op == TOKarrayliteral)
+    {
+        Expressions *elements = ((ArrayLiteralExp *)e)->elements;
+        dim = elements ? elements->dim : 0;
+    }
+    else if (e->op == TOKstring)
+        dim = ((StringExp *)e)->len;
+    else
+        return false;
+
+    if (upr == ~(size_t)0)
+        upr = dim;
+    if (lwr > upr || upr > dim)
+        return false;
+    *pbase = e;
+    *plwr = lwr;
+    *plen = upr - lwr;
+    return true;
+}
+
+/* Read element i of the array value e into *r. Return false if that has to
+ * be left to the interpreter, e.g. because i is out of bounds.
+ */
+static bool bytecodeIndex(Expression *e, dinteger_t i, unsigned ty, CtfeValue *r)
+{
+    Expression *base;
+    size_t lwr;
+    size_t len;
+    if (!bytecodeArray(e, &base, &lwr, &len) || i >= len)
+        return false;
+
+    if (base->op == TOKstring)
+    {
+        if (bytecodeIsFloat(ty))
+            return false;
+        r->i = bytecodeNormalize(((StringExp *)base)->charAt(lwr + i), ty);
+        return true;
+    }
+    Expression *el = (*((ArrayLiteralExp *)base)->elements)[lwr + (size_t)i];
+    if (bytecodeIsFloat(ty))
+    {
+        if (el->op != TOKfloat64 || !el->type->isreal())
+            return false;
+        r->f = el->toReal();
+    }
+    else
+    {
+        if (el->op != TOKint64)
+            return false;
+        r->i = bytecodeNormalize(el->toInteger(), ty);
+    }
+    return true;
+}
+
+/* Run bc with the given arguments, at call depth depth. Return false if the
+ * call has to be left to the interpreter.
+ */
+static bool runBytecode(CtfeBytecode *bc, CtfeValue *args, CtfeValue *ret, int depth)
+{
+    if (depth > CTFE_RECURSION_LIMIT)
+        return false;
+    if (depth > CtfeStatus::maxCallDepth)
+        CtfeStatus::maxCallDepth = depth;
+    ++CtfeStatus::numBytecodeCalls;
+
+    CtfeValue small[32];
+    CtfeValue *frame = bc->frameSize <= 32 ? small :
+        (CtfeValue *)mem.malloc(bc->frameSize * sizeof(CtfeValue));
+    memcpy(frame, args, bc->numParams * sizeof(CtfeValue));
+    memset(frame + bc->numParams, 0, (bc->frameSize - bc->numParams) * sizeof(CtfeValue));
+
+    bool ok = false;
+    CtfeInsn *code = bc->code.tdata();
+    for (size_t pc = 0; ; )
+    {
+        CtfeInsn *in = &code[pc++];
+        dinteger_t a = frame[in->a].i;
+        dinteger_t b = frame[in->b].i;
+        dinteger_t r;
+        switch (in->op)
+        {
+            case BCconst:   r = in->imm; break;
+            case BCadd:     r = a + b; break;
+            case BCsub:     r = a - b; break;
+            case BCmul:     r = a * b; break;
+            case BCand:     r = a & b; break;
+            case BCor:      r = a | b; break;
+            case BCxor:     r = a ^ b; break;
+            case BCneg:     r = -a; break;
+            case BCcom:     r = ~a; break;
+            case BCnot:     r = a == 0; break;
+            case BCeq:      r = a == b; break;
+            case BCne:      r = a != b; break;
+
+            case BCmove:
+                if (!bytecodeIsFloat(in->ty) && in->ty != Tarray)
+                {
+                    r = a;
+                    break;
+                }
+                frame[in->dst] = frame[in->a];
+                continue;
+
+            case BClt:
+                r = in->isunsigned ? a < b : (sinteger_t)a < (sinteger_t)b;
+                break;
+            case BCle:
+                r = in->isunsigned ? a <= b : (sinteger_t)a <= (sinteger_t)b;
+                break;
+            case BCgt:
+                r = in->isunsigned ? a > b : (sinteger_t)a > (sinteger_t)b;
+                break;
+            case BCge:
+                r = in->isunsigned ? a >= b : (sinteger_t)a >= (sinteger_t)b;
+                break;
+
+            case BCdiv:
+            case BCmod:
+                // Leave the errors to the interpreter
+                if (b == 0 || (in->op == BCmod && !in->isunsigned && (sinteger_t)b == -1))
+                    goto Lbail;
+                if (in->isunsigned)
+                    r = in->op == BCdiv ? a / b : a % b;
+                else if ((sinteger_t)b == -1)
+                    r = -a;     // long.min / -1 would trap
+                else
+                    r = in->op == BCdiv ? (sinteger_t)a / (sinteger_t)b
+                                        : (sinteger_t)a % (sinteger_t)b;
+                break;
+
+            case BCshl:
+            case BCshr:
+            case BCushr:
+                if (b >= bytecodeBits(in->opty))
+                    goto Lbail;
+                if (in->op == BCshl)
+                    r = a << b;
+                else if (in->op == BCushr && bytecodeBits(in->opty) < 64)
+                    r = (a & ((1ULL << bytecodeBits(in->opty)) - 1)) >> b;
+                else if (in->op == BCshr && bytecodeIsSigned(in->opty))
+                    r = (sinteger_t)a >> b;
+                else
+                    r = a >> b;
+                break;
+
+            // Floating point results are stored as they are, like in RealExp
+            case BCfconst:  frame[in->dst].f = bc->fconsts[(size_t)in->imm]; continue;
+            case BCfadd:    frame[in->dst].f = frame[in->a].f + frame[in->b].f; continue;
+            case BCfsub:    frame[in->dst].f = frame[in->a].f - frame[in->b].f; continue;
+            case BCfmul:    frame[in->dst].f = frame[in->a].f * frame[in->b].f; continue;
+            case BCfdiv:    frame[in->dst].f = frame[in->a].f / frame[in->b].f; continue;
+            case BCfmod:    frame[in->dst].f = Port::fmodl(frame[in->a].f, frame[in->b].f); continue;
+            case BCfneg:    frame[in->dst].f = -frame[in->a].f; continue;
+            case BCitof:
+                frame[in->dst].f = in->opty == Tuns64 ? ldouble((d_uns64)a) : ldouble((d_int64)a);
+                continue;
+
+            // Comparisons with NaN are false, except for !=
+            case BCfeq:     r = frame[in->a].f == frame[in->b].f; break;
+            case BCfne:     r = !(frame[in->a].f == frame[in->b].f); break;
+            case BCflt:     r = frame[in->a].f < frame[in->b].f; break;
+            case BCfle:     r = frame[in->a].f <= frame[in->b].f; break;
+            case BCfgt:     r = frame[in->a].f > frame[in->b].f; break;
+            case BCfge:     r = frame[in->a].f >= frame[in->b].f; break;
+            case BCftoi:    r = bytecodeRealToInteger(frame[in->a].f, in->ty); break;
+
+            case BClength:
+            {
+                Expression *base;
+                size_t lwr;
+                size_t len;
+                if (!bytecodeArray(frame[in->a].e, &base, &lwr, &len))
+                    goto Lbail;
+                r = len;
+                break;
+            }
+            case BCindex:
+                if (!bytecodeIndex(frame[in->a].e, b, in->ty, &frame[in->dst]))
+                    goto Lbail;
+                continue;
+
+            case BCjmp:
+                pc = (size_t)in->imm;
+                continue;
+            case BCjz:
+                if (!a)
+                    pc = (size_t)in->imm;
+                continue;
+            case BCjnz:
+                if (a)
+                    pc = (size_t)in->imm;
+                continue;
+
+            case BCcall:
+            {
+                FuncDeclaration *f = bc->callees[(size_t)in->imm];
+                CtfeBytecode *callee = bc->calleeCode[(size_t)in->imm];
+                if (callee && callee->disabled)
+                {
+                    // f can no longer be run as bytecode, neither can this
+                    bc->disabled = true;
+                    goto Lbail;
+                }
+                if (!callee)
+                {
+                    callee = getBytecode(f);
+                    if (!callee)
+                    {
+                        /* Don't try again if f can never be run as bytecode,
+                         * this call would only be run twice. Other failures,
+                         * like f still being analyzed, may go away.
+                         */
+                        if (noBytecode(f))
+                            bc->disabled = true;
+                        goto Lbail;
+                    }
+                    bc->calleeCode[(size_t)in->imm] = callee;
+                }
+                if (!runBytecode(callee, frame + in->a, &frame[in->dst], depth + 1))
+                {
+                    // Only a permanent failure of f disables this as well
+                    if (callee->disabled)
+                        bc->disabled = true;
+                    goto Lbail;
+                }
+                continue;
+            }
+
+            case BCret:
+                if (bytecodeIsFloat(in->ty))
+                    ret->f = frame[in->a].f;
+                else
+                    ret->i = bytecodeNormalize(a, in->ty);
+                ok = true;
+                goto Lbail;
+
+            case BCbail:
+                goto Lbail;
+
+            default:
+                assert(0);
+        }
+        frame[in->dst].i = bytecodeNormalize(r, in->ty);
+    }
+
+Lbail:
+    if (frame != small)
+        mem.free(frame);
+    return ok;
+}
+
+/* Run the call of fd with the evaluated arguments as bytecode. Return NULL if
+ * it has to be interpreted instead.
+ */
+static Expression *interpretBytecode(FuncDeclaration *fd, Expressions *arguments)
+{
+    CtfeBytecode *bc = getBytecode(fd);
+    if (!bc || arguments->dim != bc->numParams)
+        return NULL;
+
+    CtfeValue small[8];
+    CtfeValue *args = bc->numParams <= 8 ? small :
+        (CtfeValue *)mem.malloc(bc->numParams * sizeof(CtfeValue));
+    bool ok = true;
+    for (size_t i = 0; ok && i < arguments->dim; i++)
+    {
+        Expression *earg = (*arguments)[i];
+        TY ty = bytecodeSlotTy((*fd->parameters)[i]->type);
+        if (ty == Tarray)
+        {
+            Expression *base;
+            size_t lwr;
+            size_t len;
+            ok = bytecodeArray(earg, &base, &lwr, &len);
+            args[i].e = earg;
+        }
+        else if (bytecodeIsFloat(ty))
+        {
+            ok = earg->op == TOKfloat64 && earg->type->isreal();
+            if (ok)
+                args[i].f = earg->toReal();
+        }
+        else
+        {
+            ok = earg->op == TOKint64;
+            if (ok)
+                args[i].i = bytecodeNormalize(earg->toInteger(), ty);
+        }
+    }
+
+    Type *tret = ((TypeFunction *)fd->type->toBasetype())->next;
+    CtfeValue r;
+    Expression *e = NULL;
+    if (ok && runBytecode(bc, args, &r, CtfeStatus::callDepth + 1))
+    {
+        if (bytecodeIsFloat(bytecodeTy(tret)))
+            e = new RealExp(fd->loc, r.f, tret);
+        else
+            e = new IntegerExp(fd->loc, r.i, tret);
+    }
+    else if (ok)
+        ++CtfeStatus::numBytecodeFallbacks;
+    if (args != small)
+        mem.free(args);
+    return e;
+}
+
+/*************************************
+ * Memoization of pure calls.
+ * The same strongly pure functions tend to be evaluated over and over with
+ * the same arguments, e.g. table generators or the helpers building string
+ * mixins. As their result can only depend on the values of the arguments,
+ * it is kept in a hash table under those, for the rest of the compilation.
+ * Only calls whose arguments and result are plain literals are memoized.
+ */
+struct CtfeMemoEntry
+{
+    CtfeMemoEntry *next;        // next in the same bucket
+    hash_t hash;
+    FuncDeclaration *fd;
+    Expressions *args;
+    Expression *result;
+};
+
+static Array<CtfeMemoEntry *> ctfeMemo;
+static size_t ctfeMemoEntries;
+static size_t ctfeMemoSize;     // estimated number of bytes kept by the entries
+
+hash_t expressionHash(Expression *e);   // in template.c
+
+static size_t memoLiteralSize(Expression *e, size_t limit);
+
+static size_t memoElementsSize(Expressions *elements, size_t limit)
+{
+    size_t size = elements->dim * sizeof(Expression *);
+    if (size > limit)
+        return 0;
+    for (size_t i = 0; i < elements->dim; i++)
+    {
+        Expression *el = (*elements)[i];
+        size_t elsize = el ? memoLiteralSize(el, limit - size) : 0;
+        if (!elsize)
+            return 0;
+        size += elsize;
+    }
+    return size;
+}
+
+/* Return the estimated number of bytes used by literal e, or 0 if it is not
+ * a literal that can be part of a memoized call or if it needs more than
+ * limit bytes. Stops looking at e as soon as the limit is exceeded.
+ */
+static size_t memoLiteralSize(Expression *e, size_t limit)
+{
+    if (e->size > limit)
+        return 0;
+    switch (e->op)
     {
-    #if LOGCOMPILE
-        printf("%s WithStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        // If it is with(Enum) {...}, just execute the body.
-        if (s->exp->op == TOKimport || s->exp->op == TOKtype)
+        case TOKint64:
+        case TOKfloat64:
+        case TOKcomplex80:
+        case TOKnull:
+            return e->size;
+
+        case TOKstring:
         {
+            StringExp *se = (StringExp *)e;
+            if (se->len + 1 > (limit - e->size) / se->sz)
+                return 0;
+            return e->size + (se->len + 1) * se->sz;
         }
-        else
+
+        case TOKarrayliteral:
         {
-            ccf->onDeclaration(s->wthis);
-            ccf->onExpression(s->exp);
+            size_t size = memoElementsSize(((ArrayLiteralExp *)e)->elements, limit - e->size);
+            return size ? e->size + size : 0;
         }
-        if (s->body)
-            ctfeCompile(s->body);
-    }
 
-    void visit(TryCatchStatement *s)
-    {
-    #if LOGCOMPILE
-        printf("%s TryCatchStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        if (s->body)
-            ctfeCompile(s->body);
-        for (size_t i = 0; i < s->catches->dim; i++)
+        case TOKstructliteral:
         {
-            Catch *ca = (*s->catches)[i];
-            if (ca->var)
-                ccf->onDeclaration(ca->var);
-            if (ca->handler)
-                ctfeCompile(ca->handler);
+            StructLiteralExp *sle = (StructLiteralExp *)e;
+            if (!sle->elements->dim)
+                return e->size;
+            size_t size = memoElementsSize(sle->elements, limit - e->size);
+            return size ? e->size + size : 0;
         }
-    }
 
-    void visit(TryFinallyStatement *s)
-    {
-    #if LOGCOMPILE
-        printf("%s TryFinallyStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        if (s->body)
-            ctfeCompile(s->body);
-        if (s->finalbody)
-            ctfeCompile(s->finalbody);
+        default:
+            return 0;
     }
+}
 
-    void visit(ThrowStatement *s)
-    {
-    #if LOGCOMPILE
-        printf("%s ThrowStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        ccf->onExpression(s->exp);
-    }
+/* Return a deep copy of memoizable literal e. Unlike copyLiteral(), this
+ * also copies arrays referenced by struct fields.
+ */
+static Expression *copyMemoLiteral(Expression *e)
+{
+    Expressions *elements;
+    if (e->op == TOKarrayliteral)
+        elements = ((ArrayLiteralExp *)e)->elements;
+    else if (e->op == TOKstructliteral)
+        elements = ((StructLiteralExp *)e)->elements;
+    else
+        return copyLiteral(e);
 
-    void visit(GotoStatement *s)
+    Expressions *newelems = new Expressions();
+    newelems->setDim(elements->dim);
+    for (size_t i = 0; i < elements->dim; i++)
+        (*newelems)[i] = copyMemoLiteral((*elements)[i]);
+    if (e->op == TOKarrayliteral)
     {
-    #if LOGCOMPILE
-        printf("%s GotoStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-    }
+        ArrayLiteralExp *r = new ArrayLiteralExp(e->loc, newelems);
+        r->type = e->type;
+        r->ownedByCtfe = true;
+        return r;
+    }
+    StructLiteralExp *se = (StructLiteralExp *)e;
+    StructLiteralExp *r = new StructLiteralExp(e->loc, se->sd, newelems, se->stype);
+    r->type = e->type;
+    r->ownedByCtfe = true;
+    r->origin = se->origin;
+    return r;
+}
 
-    void visit(LabelStatement *s)
-    {
-    #if LOGCOMPILE
-        printf("%s LabelStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        if (s->statement)
-            ctfeCompile(s->statement);
-    }
+static bool memoElementsEqual(Expressions *elements1, Expressions *elements2);
 
-    void visit(ImportStatement *s)
+static bool memoLiteralsEqual(Expression *e1, Expression *e2)
+{
+    if (e1->op != e2->op)
+        return false;
+    switch (e1->op)
     {
-    #if LOGCOMPILE
-        printf("%s ImportStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        // Contains no variables or executable code
+        case TOKstring:
+        {
+            StringExp *se1 = (StringExp *)e1;
+            StringExp *se2 = (StringExp *)e2;
+            return se1->sz == se2->sz && se1->len == se2->len &&
+                se1->type->equals(se2->type) &&
+                memcmp(se1->string, se2->string, se1->len * se1->sz) == 0;
+        }
+
+        case TOKarrayliteral:
+            return e1->type->equals(e2->type) &&
+                memoElementsEqual(((ArrayLiteralExp *)e1)->elements,
+                                  ((ArrayLiteralExp *)e2)->elements);
+
+        case TOKstructliteral:
+            return e1->type->equals(e2->type) &&
+                memoElementsEqual(((StructLiteralExp *)e1)->elements,
+                                  ((StructLiteralExp *)e2)->elements);
+
+        default:
+            // Integers, floating point values (compared bitwise) and null
+            return e1->equals(e2);
     }
+}
 
-    void visit(ForeachRangeStatement *s)
+static bool memoElementsEqual(Expressions *elements1, Expressions *elements2)
+{
+    if (elements1->dim != elements2->dim)
+        return false;
+    for (size_t i = 0; i < elements1->dim; i++)
     {
-    #if LOGCOMPILE
-        printf("%s ForeachRangeStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        // rewritten for ForStatement
-        assert(0);
+        if (!memoLiteralsEqual((*elements1)[i], (*elements2)[i]))
+            return false;
     }
+    return true;
+}
 
-    void visit(AsmStatement *s)
+/* Return true if the result of calling fd with the evaluated arguments can
+ * be memoized, and set *psize to the estimated size of the arguments.
+ * Calls with large arguments are not memoized, as every miss would copy and
+ * hash them.
+ */
+static bool isMemoizableCall(FuncDeclaration *fd, Expressions *arguments, size_t *psize)
+{
+    if (fd->isPure() != PUREstrong || fd->isNested() || fd->needThis())
+        return false;
+    TypeFunction *tf = (TypeFunction *)fd->type->toBasetype();
+    if (tf->isref || tf->next->toBasetype()->ty == Tvoid)
+        return false;
+
+    size_t size = sizeof(CtfeMemoEntry);
+    for (size_t i = 0; i < arguments->dim; i++)
     {
-    #if LOGCOMPILE
-        printf("%s AsmStatement::ctfeCompile\n", s->loc.toChars());
-    #endif
-        // we can't compile asm statements
+        Parameter *arg = Parameter::getNth(tf->parameters, i);
+        if (arg->storageClass & (STCout | STCref | STClazy))
+            return false;
+        if (size >= CTFE_MEMO_ARGS_LIMIT)
+            return false;
+        size_t argsize = memoLiteralSize((*arguments)[i], CTFE_MEMO_ARGS_LIMIT - size);
+        if (!argsize)
+            return false;
+        size += argsize;
     }
+    *psize = size;
+    return true;
+}
 
-#if IN_LLVM
-    void visit(AsmBlockStatement *s)
+static hash_t memoHash(FuncDeclaration *fd, Expressions *arguments)
+{
+    hash_t hash = (size_t)(void *)fd;
+    for (size_t i = 0; i < arguments->dim; i++)
+        hash = hash * 31 + expressionHash((*arguments)[i]);
+    return hash;
+}
+
+/* Return a copy of the memoized result of calling fd with the given
+ * arguments, or NULL if there is none.
+ */
+static Expression *findMemoizedCall(FuncDeclaration *fd, Expressions *arguments, hash_t hash)
+{
+    if (!ctfeMemo.dim)
+        return NULL;
+    for (CtfeMemoEntry *me = ctfeMemo[hash % ctfeMemo.dim]; me; me = me->next)
     {
-#if LOGCOMPILE
-        printf("%s AsmBlockStatement::ctfeCompile\n", s->loc.toChars());
-#endif
-        // we can't compile asm statements
+        if (me->hash == hash && me->fd == fd &&
+            memoElementsEqual(me->args, arguments))
+        {
+            // The caller may modify the result in place.
+            return copyMemoLiteral(me->result);
+        }
     }
-#endif
+    return NULL;
+}
 
-    void ctfeCompile(Statement *s)
+static void addMemoizedCall(FuncDeclaration *fd, Expressions *args, hash_t hash,
+    Expression *result, size_t size)
+{
+    if (ctfeMemoSize + size >= CTFE_MEMO_LIMIT)
+        return;
+    size_t resultsize = memoLiteralSize(result, CTFE_MEMO_LIMIT - ctfeMemoSize - size);
+    if (!resultsize)
+        return;
+
+    if (ctfeMemoEntries >= ctfeMemo.dim)
     {
-        s->accept(this);
+        // Rehash into twice as many buckets
+        size_t dim = ctfeMemo.dim ? ctfeMemo.dim * 2 : 64;
+        Array<CtfeMemoEntry *> buckets;
+        buckets.setDim(dim);
+        buckets.zero();
+        for (size_t i = 0; i < ctfeMemo.dim; i++)
+        {
+            CtfeMemoEntry *me = ctfeMemo[i];
+            while (me)
+            {
+                CtfeMemoEntry *next = me->next;
+                me->next = buckets[me->hash % dim];
+                buckets[me->hash % dim] = me;
+                me = next;
+            }
+        }
+        ctfeMemo.setDim(dim);
+        memcpy(ctfeMemo.tdata(), buckets.tdata(), dim * sizeof(CtfeMemoEntry *));
     }
-};
 
-/*************************************
- * Compile this function for CTFE.
- * At present, this merely allocates variables.
+    CtfeMemoEntry *me = (CtfeMemoEntry *)mem.malloc(sizeof(CtfeMemoEntry));
+    me->hash = hash;
+    me->fd = fd;
+    me->args = args;
+    me->result = copyMemoLiteral(result);
+    me->next = ctfeMemo[hash % ctfeMemo.dim];
+    ctfeMemo[hash % ctfeMemo.dim] = me;
+    ctfeMemoEntries++;
+    ctfeMemoSize += size + resultsize;
+}
+
+/* -vctfe-profile: interpret(FuncDeclaration) records the CPU time spent in
+ * every call, interpret(Statement) counts the statements executed (not
+ * those only grouping others) and the RootObject constructor the objects
+ * (mostly CTFE values) created. The costs of nested calls are part of the
+ * totals of their callers, but not of their self costs. The time of a call
+ * includes evaluating its arguments. A function has separate profiles for
+ * every top-level evaluation it is called from. Nothing is run as bytecode
+ * while profiling, so that all calls and statements are seen.
  */
-void ctfeCompile(FuncDeclaration *fd)
+struct CtfeProfile
 {
-#if LOGCOMPILE
-    printf("\n%s FuncDeclaration::ctfeCompile %s\n", fd->loc.toChars(), fd->toChars());
-#endif
-    assert(!fd->ctfeCode);
-    assert(!fd->semantic3Errors);
-    assert(fd->semanticRun == PASSsemantic3done);
+    CtfeProfile *next;          // of the same function, for other sites
+    FuncDeclaration *fd;
+    Loc site;                   // top-level evaluation the calls were made from
+    unsigned calls;
+    double time;                // seconds spent in calls
+    double selfTime;            // ... excluding nested calls
+    unsigned long long statements;  // statements executed
+    unsigned long long selfStatements;
+    unsigned long long allocs;  // objects created
+    unsigned long long selfAllocs;
+};
 
-    fd->ctfeCode = new CompiledCtfeFunction(fd);
-    if (fd->parameters)
+struct CtfeProfileFrame
+{
+    CtfeProfileFrame *prev;
+    FuncDeclaration *fd;
+    unsigned long long statements;  // executed by fd itself
+    double childTime;
+    unsigned long long childStatements;
+    unsigned long long childAllocs;
+};
+
+static Array<CtfeProfile *> allCtfeProfiles;
+static CtfeProfileFrame *ctfeProfileStack;
+static Loc ctfeProfileSite;
+
+/* Return the profile of fd for the current top-level evaluation.
+ */
+static CtfeProfile *ctfeProfile(FuncDeclaration *fd)
+{
+    CompiledCtfeFunction *ccf = fd->ctfeCode;
+    CtfeProfile **pp = &ccf->profile;
+    while (CtfeProfile *p = *pp)
     {
-        Type *tb = fd->type->toBasetype();
-        assert(tb->ty == Tfunction);
-        for (size_t i = 0; i < fd->parameters->dim; i++)
+        if (p->site.equals(ctfeProfileSite))
         {
-            VarDeclaration *v = (*fd->parameters)[i];
-            fd->ctfeCode->onDeclaration(v);
+            // Move it to the front, the next calls are likely from here too
+            *pp = p->next;
+            p->next = ccf->profile;
+            ccf->profile = p;
+            return p;
         }
+        pp = &p->next;
     }
-    if (fd->vresult)
-        fd->ctfeCode->onDeclaration(fd->vresult);
-    CtfeCompiler v(fd->ctfeCode);
-    v.ctfeCompile(fd->fbody);
+
+    CtfeProfile *p = new CtfeProfile();
+    p->fd = fd;
+    p->site = ctfeProfileSite;
+    p->next = ccf->profile;
+    ccf->profile = p;
+    allCtfeProfiles.push(p);
+    return p;
+}
+
+static int ctfeProfileCmp(const void *p1, const void *p2)
+{
+    CtfeProfile *s1 = *(CtfeProfile **)p1;
+    CtfeProfile *s2 = *(CtfeProfile **)p2;
+    if (s1->time != s2->time)
+        return s1->time < s2->time ? 1 : -1;
+    if (s1->calls != s2->calls)
+        return s1->calls < s2->calls ? 1 : -1;
+    return 0;
+}
+
+static void sortCtfeProfiles()
+{
+    qsort(allCtfeProfiles.tdata(), allCtfeProfiles.dim, sizeof(CtfeProfile *), &ctfeProfileCmp);
+}
+
+/*******************************************
+ * Print the CTFE profile to global.stdmsg, the most expensive functions
+ * first.
+ */
+void printCtfeProfile()
+{
+    sortCtfeProfiles();
+    fprintf(global.stdmsg, "   time(s)    self(s)      calls  statements      allocs  function\n");
+    for (size_t i = 0; i < allCtfeProfiles.dim; i++)
+    {
+        CtfeProfile *s = allCtfeProfiles[i];
+        fprintf(global.stdmsg, "%10.3f %10.3f %10u %11llu %11llu  %s at %s, evaluated from %s\n",
+            s->time, s->selfTime, s->calls, s->statements, s->allocs,
+            s->fd->toPrettyChars(), s->fd->loc.toChars(), s->site.toChars());
+    }
+}
+
+/*******************************************
+ * Write the CTFE profile to buf as a JSON array, the most expensive
+ * functions first.
+ */
+void writeCtfeProfileJson(OutBuffer *buf)
+{
+    sortCtfeProfiles();
+    buf->writestring("[\n");
+    for (size_t i = 0; i < allCtfeProfiles.dim; i++)
+    {
+        CtfeProfile *s = allCtfeProfiles[i];
+        buf->writestring(" {\n  \"name\" : ");
+        json_string(buf, s->fd->toPrettyChars());
+        buf->writestring(",\n  \"location\" : ");
+        json_string(buf, s->fd->loc.toChars());
+        buf->writestring(",\n  \"evaluatedFrom\" : ");
+        json_string(buf, s->site.toChars());
+        buf->printf(",\n  \"calls\" : %u", s->calls);
+        buf->printf(",\n  \"time\" : %.6f,\n  \"selfTime\" : %.6f",
+            s->time, s->selfTime);
+        buf->printf(",\n  \"statements\" : %llu,\n  \"selfStatements\" : %llu",
+            s->statements, s->selfStatements);
+        buf->printf(",\n  \"allocs\" : %llu,\n  \"selfAllocs\" : %llu\n }",
+            s->allocs, s->selfAllocs);
+        buf->writestring(i + 1 < allCtfeProfiles.dim ? ",\n" : "\n");
+    }
+    buf->writestring("]\n");
 }
+#endif
 
 /*************************************
  *
  * Entry point for CTFE.
  * A compile-time result is required. Give an error if not possible
  */
+#if IN_LLVM
+/* Evaluate e with all intermediate values allocated in a CTFE arena, which is
+ * released afterwards. Only the result is copied out.
+ */
+static Expression *interpretInArena(Expression *e)
+{
+    CtfeArena arena;
+    Expression *result = e->interpret(NULL);
+    if (exceptionOrCantInterpret(result) || result == EXP_VOID_INTERPRET)
+    {
+        // Uncaught exceptions are reported by scrubReturnValue()'s caller
+        if (result->op == TOKthrownexception)
+            arena.keep();
+        return result;
+    }
+    Expression *copy = copyOutOfArena(result);
+    if (!copy)
+    {
+        arena.keep();
+        return result;
+    }
+    return copy;
+}
+#endif
+
 Expression *ctfeInterpret(Expression *e)
 {
     if (e->op == TOKerror)
@@ -738,9 +2422,23 @@ Expression *ctfeInterpret(Expression *e)
     ctfeCodeGlobal.callingloc = e->loc;
     ctfeCodeGlobal.onExpression(e);
 
+#if IN_LLVM
+    Loc oldProfileSite = ctfeProfileSite;
+    ctfeProfileSite = e->loc;
+    Expression *result = global.params.ctfeArena ? interpretInArena(e) :
+        e->interpret(NULL);
+    ctfeProfileSite = oldProfileSite;
+#else
     Expression *result = e->interpret(NULL);
+#endif
     if (result != EXP_CANT_INTERPRET)
+    {
+#if IN_LLVM
+        // Still inside the arena of an enclosing evaluation, if any
+        CtfeArenaSuspend suspend;
+#endif
         result = scrubReturnValue(e->loc, result);
+    }
     if (result == EXP_CANT_INTERPRET)
     {
         assert(global.errors != olderrors);
@@ -811,7 +2509,64 @@ Expression *ctfeInterpretForPragmaMsg(Expression *e)
  * or EXP_VOID_INTERPRET if function returned void.
  */
 
+#if IN_LLVM
+static Expression *interpretCall(FuncDeclaration *fd, InterState *istate, Expressions *arguments, Expression *thisarg);
+
+Expression *interpret(FuncDeclaration *fd, InterState *istate, Expressions *arguments, Expression *thisarg)
+{
+    if (!global.params.vctfeProfile)
+        return interpretCall(fd, istate, arguments, thisarg);
+
+    CtfeProfileFrame frame;
+    frame.prev = ctfeProfileStack;
+    frame.fd = fd;
+    frame.statements = 0;
+    frame.childTime = 0;
+    frame.childStatements = 0;
+    frame.childAllocs = 0;
+    ctfeProfileStack = &frame;
+    clock_t start = clock();
+    unsigned long long startAllocs = RootObject::numCreated;
+
+    Expression *e = interpretCall(fd, istate, arguments, thisarg);
+
+    double time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    unsigned long long allocs = RootObject::numCreated - startAllocs;
+    unsigned long long statements = frame.statements + frame.childStatements;
+    ctfeProfileStack = frame.prev;
+    if (frame.prev)
+    {
+        frame.prev->childTime += time;
+        frame.prev->childStatements += statements;
+        frame.prev->childAllocs += allocs;
+    }
+
+    // Nothing to attribute the call to if the function failed semantic
+    if (!fd->ctfeCode)
+        return e;
+
+    CtfeProfile *p = ctfeProfile(fd);
+    p->calls++;
+    p->selfTime += time - frame.childTime;
+    p->selfStatements += frame.statements;
+    p->selfAllocs += allocs - frame.childAllocs;
+
+    // Don't count recursive calls twice
+    for (CtfeProfileFrame *f = frame.prev; f; f = f->prev)
+    {
+        if (f->fd == fd)
+            return e;
+    }
+    p->time += time;
+    p->statements += statements;
+    p->allocs += allocs;
+    return e;
+}
+
+static Expression *interpretCall(FuncDeclaration *fd, InterState *istate, Expressions *arguments, Expression *thisarg)
+#else
 Expression *interpret(FuncDeclaration *fd, InterState *istate, Expressions *arguments, Expression *thisarg)
+#endif
 {
 #if LOG
     printf("\n********\n%s FuncDeclaration::interpret(istate = %p) %s\n", fd->loc.toChars(), istate, fd->toChars());
@@ -932,6 +2687,37 @@ Expression *interpret(FuncDeclaration *fd, InterState *istate, Expressions *argu
         }
     }
 
+#if IN_LLVM
+    // The calls made by bytecode and its statements can't be profiled
+    if (!thisarg && !global.params.vctfeProfile)
+    {
+        Expression *e = interpretBytecode(fd, &eargs);
+        if (e)
+            return e;
+    }
+
+    // The arguments are copied before the call, which may modify them.
+    Expressions *memoArgs = NULL;
+    hash_t memoHashValue = 0;
+    size_t memoSize = 0;
+    if (!thisarg && isMemoizableCall(fd, &eargs, &memoSize))
+    {
+        memoHashValue = memoHash(fd, &eargs);
+        Expression *e = findMemoizedCall(fd, &eargs, memoHashValue);
+        if (e)
+        {
+            ++CtfeStatus::numMemoHits;
+            return e;
+        }
+        ++CtfeStatus::numMemoMisses;
+        CtfeArenaSuspend suspend;
+        memoArgs = new Expressions();
+        memoArgs->setDim(dim);
+        for (size_t i = 0; i < dim; i++)
+            (*memoArgs)[i] = copyMemoLiteral(eargs[i]);
+    }
+#endif
+
     // Now that we've evaluated all the arguments, we can start the frame
     // (this is the moment when the 'call' actually takes place).
 
@@ -1075,6 +2861,14 @@ Expression *interpret(FuncDeclaration *fd, InterState *istate, Expressions *argu
         return EXP_CANT_INTERPRET;
     }
 
+#if IN_LLVM
+    if (memoArgs)
+    {
+        CtfeArenaSuspend suspend;
+        addMemoizedCall(fd, memoArgs, memoHashValue, e, memoSize);
+    }
+#endif
+
     return e;
 }
 
@@ -2405,8 +4199,19 @@ public:
                 if (e && e != EXP_CANT_INTERPRET && e->op != TOKthrownexception)
                 {
                     e = copyLiteral(e);
+#if IN_LLVM
+                    // The value is kept for later evaluations, so it must not
+                    // be in the CTFE arena.
+                    Expression *saved = CtfeArena::current ? copyOutOfArena(e) : e;
+                    if (saved && (v->isDataseg() || (v->storage_class & STCmanifest )))
+                    {
+                        e = saved;
+                        ctfeStack.saveGlobalConstant(v, e);
+                    }
+#else
                     if (v->isDataseg() || (v->storage_class & STCmanifest ))
                         ctfeStack.saveGlobalConstant(v, e);
+#endif
                 }
             }
             else if (v->isCTFE() && !hasValue(v))
@@ -3003,10 +4808,26 @@ public:
             return ae;
         }
         assert(argnum == arguments->dim - 1);
+#if IN_LLVM
+        if (isPackedCtfeArray(newtype))
+        {
+            Type *tb = elemType->toBasetype();
+            StringExp *se = createBlockDuplicatedStringLiteral(loc, newtype,
+                (unsigned)(elemType->defaultInitLiteral(loc)->toInteger()),
+                len, (unsigned char)tb->size());
+            if (tb->ty != Tchar && tb->ty != Twchar && tb->ty != Tdchar)
+            {
+                ++CtfeStatus::numPackedArrays;
+                se->ctfePacked = true;
+            }
+            return se;
+        }
+#else
         if (elemType->ty == Tchar || elemType->ty == Twchar || elemType->ty == Tdchar)
             return createBlockDuplicatedStringLiteral(loc, newtype,
                 (unsigned)(elemType->defaultInitLiteral(loc)->toInteger()),
                 len, (unsigned char)elemType->size());
+#endif
         return createBlockDuplicatedArrayLiteral(loc, newtype,
             elemType->defaultInitLiteral(loc), len);
     }
@@ -3673,7 +5494,21 @@ public:
                 }
                 else
                 {
+#if IN_LLVM
+                    Expression *appended = NULL;
+                    if (e->op == TOKcatass)
+                        appended = ctfeAppend(e->loc, e->type, oldval, newval);
+                    if (appended)
+                        newval = appended;
+                    else
+                    {
+                        if (e->op == TOKcatass)
+                            ++CtfeStatus::numArrayAllocs;
+                        newval = (*fp)(e->type, oldval, newval);
+                    }
+#else
                     newval = (*fp)(e->type, oldval, newval);
+#endif
                 }
                 if (newval == EXP_CANT_INTERPRET)
                 {
@@ -6540,6 +8375,11 @@ Expression *interpret(Expression *e, InterState *istate, CtfeGoal goal)
 
 Expression *interpret(Statement *s, InterState *istate)
 {
+#if IN_LLVM
+    if (ctfeProfileStack && !s->isCompoundStatement() && !s->isScopeStatement() &&
+        !s->isLabelStatement() && !s->isCaseStatement() && !s->isDefaultStatement())
+        ++ctfeProfileStack->statements;
+#endif
     Interpreter v(istate, ctfeNeedNothing);
     s->accept(&v);
     return v.result;
@@ -6590,6 +8430,10 @@ Expression *scrubReturnValue(Loc loc, Expression *e)
     }
     if (e->op == TOKstring)
     {
+#if IN_LLVM
+        e = unpackArrayLiteral((StringExp *)e);
+        if (e->op == TOKstring)
+#endif
         ((StringExp *)e)->ownedByCtfe = false;
     }
     if (e->op == TOKarrayliteral)
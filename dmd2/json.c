@@ -888,6 +888,17 @@ public:
 };
 
 
+#if IN_LLVM
+/*********************************
+ * Write s to buf as a JSON string literal.
+ */
+void json_string(OutBuffer *buf, const char *s)
+{
+    ToJsonVisitor json(buf);
+    json.value(s);
+}
+#endif
+
 void json_generate(OutBuffer *buf, Modules *modules)
 {
     ToJsonVisitor json(buf);
@@ -21,6 +21,9 @@
 struct OutBuffer;
 
 void json_generate(OutBuffer *, Modules *);
+#if IN_LLVM
+void json_string(OutBuffer *, const char *);
+#endif
 
 #endif /* DMD_JSON_H */
 
@@ -40,6 +40,9 @@
 #include "identifier.h"
 #include "id.h"
 #include "module.h"
+#if IN_LLVM
+#include "driver/tokencache.h"
+#endif
 
 extern int HtmlNamedEntity(const utf8_t *p, size_t length);
 
@@ -269,6 +272,10 @@ Lexer::Lexer(Module *mod,
     this->doDocComment = doDocComment;
     this->anyToken = 0;
     this->commentToken = commentToken;
+#if IN_LLVM
+    this->tokenCache = NULL;
+    this->numDiagnostics = 0;
+#endif
     //initKeywords();
 
     /* If first line starts with '#!', ignore the line
@@ -325,6 +332,9 @@ Loc Lexer::loc()
 
 void Lexer::error(const char *format, ...)
 {
+#if IN_LLVM
+    ++numDiagnostics;
+#endif
     va_list ap;
     va_start(ap, format);
     ::verror(token.loc, format, ap);
@@ -333,6 +343,9 @@ void Lexer::error(const char *format, ...)
 
 void Lexer::error(Loc loc, const char *format, ...)
 {
+#if IN_LLVM
+    ++numDiagnostics;
+#endif
     va_list ap;
     va_start(ap, format);
     ::verror(loc, format, ap);
@@ -341,6 +354,9 @@ void Lexer::error(Loc loc, const char *format, ...)
 
 void Lexer::deprecation(const char *format, ...)
 {
+#if IN_LLVM
+    ++numDiagnostics;
+#endif
     va_list ap;
     va_start(ap, format);
     ::vdeprecation(token.loc, format, ap);
@@ -358,6 +374,11 @@ TOK Lexer::nextToken()
     }
     else
     {
+#if IN_LLVM
+        if (tokenCache)
+            tokenCache->scan(this, &token);
+        else
+#endif
         scan(&token);
     }
     //token.print();
@@ -372,6 +393,11 @@ Token *Lexer::peek(Token *ct)
     else
     {
         t = Token::alloc();
+#if IN_LLVM
+        if (tokenCache)
+            tokenCache->scan(this, t);
+        else
+#endif
         scan(t);
         ct->next = t;
     }
@@ -231,6 +231,10 @@ struct Token
     static const char *toChars(TOK);
 };
 
+#if IN_LLVM
+class TokenCache;
+#endif
+
 class Lexer
 {
 public:
@@ -249,6 +253,10 @@ public:
     int doDocComment;           // collect doc comment information
     int anyToken;               // !=0 means seen at least one token
     int commentToken;           // !=0 means comments are TOKcomment's
+#if IN_LLVM
+    TokenCache *tokenCache;     // if set, provides the tokens instead of scan()
+    unsigned numDiagnostics;    // errors and deprecations reported so far
+#endif
 
     Lexer(Module *mod,
         const utf8_t *base, size_t begoffset, size_t endoffset,
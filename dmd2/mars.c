@@ -167,7 +167,12 @@ bool Global::endGagging(unsigned oldGagged)
 void Global::increaseErrorCount()
 {
     if (gag)
+    {
         ++gaggedErrors;
+#if IN_LLVM
+        ++gaggedErrorsSeen;
+#endif
+    }
     ++errors;
 }
 
@@ -299,6 +304,9 @@ void verror(Loc loc, const char *format, va_list ap,
         //fprintf(stderr, "(gag:%d) ", global.gag);
         //verrorPrint(loc, header, format, ap, p1, p2);
         global.gaggedErrors++;
+#if IN_LLVM
+        global.gaggedErrorsSeen++;
+#endif
     }
     global.errors++;
 }
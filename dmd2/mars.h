@@ -254,6 +254,9 @@ struct Param
     OUTPUTFLAG output_o;
     bool useInlineAsm;
     bool verbose_cg;
+    bool vtemplates;    // collect template instantiation statistics
+    bool vctfeProfile;  // collect per-function CTFE statistics
+    bool ctfeArena;     // release the memory of each CTFE evaluation
 
     // target stuff
     llvm::Triple targetTriple;
@@ -312,6 +315,9 @@ struct Global
     FILE *stdmsg;          // where to send verbose messages
     unsigned gag;          // !=0 means gag reporting of errors & warnings
     unsigned gaggedErrors; // number of errors reported while gagged
+#if IN_LLVM
+    unsigned gaggedErrorsSeen; // like gaggedErrors, but never reset by endGagging()
+#endif
 
     /* Start gagging. Return the current number of gagged errors
      */
@@ -11,8 +11,19 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+#if IN_LLVM && POSIX && !__APPLE__
+// Directory listings are case sensitive, which does not match the default
+// file systems on OS X.
+#define CACHE_SOURCE_DIRS 1
+#include <dirent.h>
+#include <errno.h>
+#include <map>
+#include <string>
+#endif
+
 #include "mars.h"
 #include "module.h"
 #include "parse.h"
@@ -24,6 +35,11 @@
 #include "hdrgen.h"
 #include "expression.h"
 #include "lexer.h"
+#include "template.h"
+#if IN_LLVM
+#include "aav.h"
+#include "driver/tokencache.h"
+#endif
 
 #ifdef IN_GCC
 #include "d-dmd-gcc.h"
@@ -37,7 +53,22 @@ Modules Module::amodules;
 
 Dsymbols Module::deferred; // deferred Dsymbol's needing semantic() run on them
 Dsymbols Module::deferred3;
+#if IN_LLVM
+Dsymbols Module::speculative3;
+unsigned Module::numSpeculativeSkipped;
+Dsymbols Module::deferredDeps;
+unsigned Module::numDeferredPasses;
+unsigned Module::numDeferredRuns;
+unsigned Module::numDeferredSkipped;
+unsigned Module::numDeferrals;
+#endif
 unsigned Module::dprogress;
+#if IN_LLVM
+unsigned Module::searchDepth;
+unsigned Module::searchCutoffDepth = ~0u;
+unsigned Module::numFileProbes;
+unsigned Module::numFileProbesAvoided;
+#endif
 
 const char *lookForSourceFile(const char *filename);
 
@@ -287,7 +318,11 @@ Module *Module::load(Loc loc, Identifiers *packages, Identifier *ident)
 bool Module::read(Loc loc)
 {
     //printf("Module::read('%s') file '%s'\n", toChars(), srcfile->toChars());
+#if IN_LLVM && POSIX
+    if (srcfile->mmread())
+#else
     if (srcfile->read())
+#endif
     {
         if (!strcmp(srcfile->toChars(), "object.d"))
         {
@@ -600,6 +635,10 @@ void Module::parse()
     {
 #if IN_LLVM
         Parser p(this, buf, buflen, gen_docs);
+        // Imports are not edited often, so they are worth caching.
+        unsigned errors = global.errors;
+        if (!isRoot())
+            p.tokenCache = TokenCache::create(&p, buf, buflen, gen_docs);
 #else
         Parser p(this, buf, buflen, docfile != NULL);
 #endif
@@ -607,10 +646,21 @@ void Module::parse()
         members = p.parseModule();
         md = p.md;
         numlines = p.scanloc.linnum;
+#if IN_LLVM
+        if (p.tokenCache)
+        {
+            p.tokenCache->finish(&p, global.errors == errors);
+            delete p.tokenCache;
+        }
+#endif
     }
 
     if (srcfile->ref == 0)
         ::free(srcfile->buffer);
+#if IN_LLVM
+    else if (srcfile->ref == 2)
+        srcfile->unmap();
+#endif
     srcfile->buffer = NULL;
     srcfile->len = 0;
 
@@ -760,6 +810,9 @@ void Module::importAll(Scope *prevsc)
     {
         // Add all symbols into module's symbol table
         symtab = new DsymbolTable();
+#if IN_LLVM
+        searchGeneration++;
+#endif
         for (size_t i = 0; i < members->dim; i++)
         {
             Dsymbol *s = (*members)[i];
@@ -872,6 +925,10 @@ void Module::semantic3()
     {
         Dsymbol *s = (*members)[i];
         //printf("Module %s: %s.semantic3()\n", toChars(), s->toChars());
+#if IN_LLVM
+        if (skipSpeculative(s))
+            continue;
+#endif
         s->semantic3(sc);
     }
 
@@ -928,7 +985,14 @@ Dsymbol *Module::search(Loc loc, Identifier *ident, int flags)
 
     //printf("%s Module::search('%s', flags = %d) insearch = %d\n", toChars(), ident->toChars(), flags, insearch);
     if (insearch)
+    {
+#if IN_LLVM
+        // The search results of the modules above this one are incomplete.
+        if ((unsigned)insearch < searchCutoffDepth)
+            searchCutoffDepth = insearch;
+#endif
         return NULL;
+    }
     if (searchCacheIdent == ident && searchCacheFlags == flags)
     {
         //printf("%s Module::search('%s', flags = %d) insearch = %d searchCacheSymbol = %s\n",
@@ -938,8 +1002,14 @@ Dsymbol *Module::search(Loc loc, Identifier *ident, int flags)
 
     unsigned int errors = global.errors;
 
+#if IN_LLVM
+    insearch = ++searchDepth;
+    Dsymbol *s = ScopeDsymbol::search(loc, ident, flags);
+    --searchDepth;
+#else
     insearch = 1;
     Dsymbol *s = ScopeDsymbol::search(loc, ident, flags);
+#endif
     insearch = 0;
 
     if (errors == global.errors)
@@ -972,8 +1042,23 @@ void Module::clearCache()
  * Can't run semantic on s now, try again later.
  */
 
+#if IN_LLVM
+/* While runDeferredSemantic() makes a pass, the symbols queued for it which
+ * have not been run yet, or have been deferred again (maps them to
+ * themselves, or to NULL once run).
+ */
+static AA *deferredPending;
+
+void Module::addDeferredSemantic(Dsymbol *s, Dsymbol *dep)
+#else
 void Module::addDeferredSemantic(Dsymbol *s)
+#endif
 {
+#if IN_LLVM
+    numDeferrals++;
+    if (deferredPending)
+        *dmd_aaGet(&deferredPending, (void *)s) = (void *)s;
+#endif
     // Don't add it if it is already there
     for (size_t i = 0; i < deferred.dim; i++)
     {
@@ -985,6 +1070,9 @@ void Module::addDeferredSemantic(Dsymbol *s)
 
     //printf("Module::addDeferredSemantic('%s')\n", s->toChars());
     deferred.push(s);
+#if IN_LLVM
+    deferredDeps.push(dep != s ? dep : NULL);
+#endif
 }
 
 
@@ -992,6 +1080,116 @@ void Module::addDeferredSemantic(Dsymbol *s)
  * Run semantic() on deferred symbols.
  */
 
+#if IN_LLVM
+/* Each pass used to run semantic() on all the deferred symbols, and passes
+ * were repeated as long as any of them made progress. A symbol waiting for
+ * another one later in the list thus only succeeded in the next pass, which is
+ * quadratic for long chains of such symbols.
+ *
+ * Where it is known what a symbol waits for (passed to addDeferredSemantic(),
+ * e.g. a base class or the type of a field), the symbol is now put aside
+ * while that dependency is still pending, and run as soon as the dependency
+ * has been run successfully. As the dependencies are not known in all cases,
+ * a pass which runs all symbols is made before giving up, so that the result
+ * is the same as before.
+ */
+void Module::runDeferredSemantic()
+{
+    if (dprogress == 0)
+        return;
+
+    static int nested;
+    if (nested)
+        return;
+    nested++;
+
+    bool all = false;
+    size_t len;
+    while (1)
+    {
+        dprogress = 0;
+        len = deferred.dim;
+        if (!len)
+            break;
+        numDeferredPasses++;
+
+        Dsymbols todo;
+        Dsymbols todoDeps;
+        todo.setDim(len);
+        todoDeps.setDim(len);
+        memcpy(todo.tdata(), deferred.tdata(), len * sizeof(Dsymbol *));
+        memcpy(todoDeps.tdata(), deferredDeps.tdata(), len * sizeof(Dsymbol *));
+        deferred.setDim(0);
+        deferredDeps.setDim(0);
+
+        deferredPending = NULL;
+        for (size_t i = 0; i < len; i++)
+            *dmd_aaGet(&deferredPending, (void *)todo[i]) = (void *)todo[i];
+
+        AA *waiters = NULL;     // dependency => Dsymbols waiting for it
+        Dsymbols waitedFor;     // the keys of waiters
+        size_t nwaiting = 0;
+        Dsymbols ready;
+        for (size_t i = 0; i < len; i++)
+        {
+            Dsymbol *s = todo[i];
+            Dsymbol *dep = todoDeps[i];
+            if (!all && dep && dmd_aaGetRvalue(deferredPending, (void *)dep))
+            {
+                Dsymbols **pw = (Dsymbols **)dmd_aaGet(&waiters, (void *)dep);
+                if (!*pw)
+                {
+                    *pw = new Dsymbols();
+                    waitedFor.push(dep);
+                }
+                (*pw)->push(s);
+                nwaiting++;
+                numDeferredSkipped++;
+                continue;
+            }
+
+            // Run s, then whatever waited for the symbols run successfully
+            ready.setDim(0);
+            ready.push(s);
+            for (size_t j = 0; j < ready.dim; j++)
+            {
+                Dsymbol *sx = ready[j];
+                *dmd_aaGet(&deferredPending, (void *)sx) = NULL;
+                sx->semantic(NULL);
+                numDeferredRuns++;
+                //printf("deferred: %s, parent = %s\n", sx->toChars(), sx->parent->toChars());
+                if (dmd_aaGetRvalue(deferredPending, (void *)sx))
+                    continue;   // deferred again
+
+                Dsymbols *w = (Dsymbols *)dmd_aaGetRvalue(waiters, (void *)sx);
+                if (w && w->dim)
+                {
+                    ready.append(w);
+                    nwaiting -= w->dim;
+                    w->setDim(0);
+                }
+            }
+        }
+
+        // Those still waiting have not been run in this pass at all
+        for (size_t i = 0; i < waitedFor.dim; i++)
+        {
+            Dsymbols *w = (Dsymbols *)dmd_aaGetRvalue(waiters, (void *)waitedFor[i]);
+            for (size_t j = 0; j < w->dim; j++)
+                addDeferredSemantic((*w)[j], waitedFor[i]);
+        }
+        deferredPending = NULL;
+
+        if (deferred.dim < len || dprogress)
+            all = false;    // while making progress
+        else if (!all && nwaiting)
+            all = true;     // try once more with everything
+        else
+            break;
+    }
+    nested--;
+}
+#else
 void Module::runDeferredSemantic()
 {
     if (dprogress == 0)
@@ -1041,6 +1239,7 @@ void Module::runDeferredSemantic()
     nested--;
     //printf("-Module::runDeferredSemantic(), len = %d\n", deferred.dim);
 }
+#endif
 
 void Module::addDeferredSemantic3(Dsymbol *s)
 {
@@ -1054,9 +1253,83 @@ void Module::addDeferredSemantic3(Dsymbol *s)
     deferred3.push(s);
 }
 
+#if IN_LLVM
+/****************************************
+ * Template instances which are only used speculatively (see
+ * TemplateInstance::isSpeculativeOnly()) are never code generated, so there
+ * is no need to analyze the function bodies in them, which often instantiate
+ * more templates in turn. Instead of running semantic3() for them, they are
+ * remembered in speculative3, and only analyzed by runDeferredSemantic3() if
+ * a later instantiation has made them non-speculative meanwhile.
+ *
+ * Template functions instantiated inside of a function still run semantic3()
+ * right away, as their attributes need to be inferred.
+ *
+ * With -allinst, -unittest or -debug, TemplateInstance::needsCodegen() asks
+ * for code of speculative instances too (the workaround for Bugzilla 11239),
+ * so they are analyzed as before then.
+ */
+bool Module::skipSpeculative(Dsymbol *s)
+{
+    TemplateInstance *ti = s->isTemplateInstance();
+    if (!ti || ti->isTemplateMixin() ||
+        global.params.allInst || global.params.useUnitTests || global.params.debuglevel ||
+        ti->semanticRun >= PASSsemantic3 || !ti->isSpeculativeOnly())
+        return false;
+
+    // It may be deferred again while still skipped, record it only once
+    if (!ti->inSpeculative3)
+    {
+        ti->inSpeculative3 = true;
+        speculative3.push(ti);
+        numSpeculativeSkipped++;
+    }
+    return true;
+}
+#endif
+
 void Module::runDeferredSemantic3()
 {
     Dsymbols *a = &Module::deferred3;
+#if IN_LLVM
+    size_t i = 0;
+    while (1)
+    {
+        for (; i < a->dim; i++)
+        {
+            Dsymbol *s = (*a)[i];
+            if (skipSpeculative(s))
+                continue;
+
+            s->semantic3(NULL);
+
+            if (global.errors)
+                return;
+        }
+
+        /* Analyze the skipped instances which are no longer speculative,
+         * which might add more deferred symbols or promote more instances.
+         */
+        bool promoted = false;
+        for (size_t j = 0; j < speculative3.dim; j++)
+        {
+            TemplateInstance *ti = speculative3[j]->isTemplateInstance();
+            if (ti->isSpeculativeOnly())
+                continue;
+            speculative3.remove(j--);
+            ti->inSpeculative3 = false;
+            numSpeculativeSkipped--;
+            promoted = true;
+
+            ti->semantic3(NULL);
+
+            if (global.errors)
+                return;
+        }
+        if (!promoted && i == a->dim)
+            break;
+    }
+#else
     for (size_t i = 0; i < a->dim; i++)
     {
         Dsymbol *s = (*a)[i];
@@ -1067,6 +1340,7 @@ void Module::runDeferredSemantic3()
         if (global.errors)
             break;
     }
+#endif
 }
 
 /************************************
@@ -1264,6 +1538,108 @@ Dsymbol *Package::search(Loc loc, Identifier *ident, int flags)
 
 /* ===========================  ===================== */
 
+#if CACHE_SOURCE_DIRS
+/* Listings of the directories searched for source files, mapping the names of
+ * their entries to the result of FileName::exists(), or to 0 if the type is not
+ * known from the listing.
+ * Most probes are for files that do not exist, because every import path is
+ * tried for every module, so this saves a stat() per import path and module.
+ */
+typedef std::map<std::string, int> DirEntries;
+static std::map<std::string, DirEntries *> sourceDirs;
+static DirEntries unlistedDir;     // exists, but cannot be read
+
+static DirEntries *listSourceDir(const std::string &dir)
+{
+    std::map<std::string, DirEntries *>::iterator it = sourceDirs.find(dir);
+    if (it != sourceDirs.end())
+        return it->second;
+
+    // Directories that do not exist are cached as NULL.
+    DirEntries *entries = NULL;
+    DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+    if (!d && errno != ENOENT && errno != ENOTDIR)
+        entries = &unlistedDir;
+    else if (d)
+    {
+        entries = new DirEntries();
+        while (struct dirent *e = readdir(d))
+        {
+            int type = 0;
+#ifdef _DIRENT_HAVE_D_TYPE
+            if (e->d_type == DT_REG)
+                type = 1;
+            else if (e->d_type == DT_DIR)
+                type = 2;
+#endif
+            (*entries)[e->d_name] = type;
+        }
+        closedir(d);
+    }
+    sourceDirs[dir] = entries;
+    return entries;
+}
+
+void Module::clearSourceDirCache()
+{
+    for (std::map<std::string, DirEntries *>::iterator it = sourceDirs.begin();
+         it != sourceDirs.end(); ++it)
+    {
+        if (it->second != &unlistedDir)
+            delete it->second;
+    }
+    sourceDirs.clear();
+}
+#elif IN_LLVM
+void Module::clearSourceDirCache()
+{
+}
+#endif
+
+/********************************************
+ * Same as FileName::exists(), but answers from the cached directory listing
+ * where possible.
+ */
+
+static int sourceFileExists(const char *name)
+{
+#if IN_LLVM
+    Module::numFileProbes++;
+#endif
+#if CACHE_SOURCE_DIRS
+    const char *slash = strrchr(name, '/');
+    std::string dir;
+    if (slash)
+        dir.assign(name, slash == name ? 1 : slash - name);
+    const char *base = slash ? slash + 1 : name;
+    if (*base && strcmp(base, ".") != 0 && strcmp(base, "..") != 0)
+    {
+        DirEntries *entries = listSourceDir(dir);
+        if (!entries)
+        {
+            Module::numFileProbesAvoided++;
+            return 0;
+        }
+        if (entries != &unlistedDir)
+        {
+            DirEntries::iterator it = entries->find(base);
+            if (it == entries->end())
+            {
+                Module::numFileProbesAvoided++;
+                return 0;
+            }
+            if (it->second)
+            {
+                Module::numFileProbesAvoided++;
+                return it->second;
+            }
+            // Symbolic links and the like need to be resolved.
+        }
+    }
+#endif
+    return FileName::exists(name);
+}
+
 /********************************************
  * Look for the source file if it's different from filename.
  * Look for .di, .d, directory, and along global.path.
@@ -1282,21 +1658,21 @@ const char *lookForSourceFile(const char *filename)
      */
 
     const char *sdi = FileName::forceExt(filename, global.hdr_ext);
-    if (FileName::exists(sdi) == 1)
+    if (sourceFileExists(sdi) == 1)
         return sdi;
 
     const char *sd  = FileName::forceExt(filename, global.mars_ext);
-    if (FileName::exists(sd) == 1)
+    if (sourceFileExists(sd) == 1)
         return sd;
 
-    if (FileName::exists(filename) == 2)
+    if (sourceFileExists(filename) == 2)
     {
         /* The filename exists and it's a directory.
          * Therefore, the result should be: filename/package.d
          * iff filename/package.d is a file
          */
         const char *n = FileName::combine(filename, "package.d");
-        if (FileName::exists(n) == 1)
+        if (sourceFileExists(n) == 1)
             return n;
         FileName::free(n);
     }
@@ -1312,22 +1688,22 @@ const char *lookForSourceFile(const char *filename)
         const char *p = (*global.path)[i];
 
         const char *n = FileName::combine(p, sdi);
-        if (FileName::exists(n) == 1)
+        if (sourceFileExists(n) == 1)
             return n;
         FileName::free(n);
 
         n = FileName::combine(p, sd);
-        if (FileName::exists(n) == 1)
+        if (sourceFileExists(n) == 1)
             return n;
         FileName::free(n);
 
         const char *b = FileName::removeExt(filename);
         n = FileName::combine(p, b);
         FileName::free(b);
-        if (FileName::exists(n) == 2)
+        if (sourceFileExists(n) == 2)
         {
             const char *n2 = FileName::combine(n, "package.d");
-            if (FileName::exists(n2) == 1)
+            if (sourceFileExists(n2) == 1)
                 return n2;
             FileName::free(n2);
         }
@@ -80,6 +80,15 @@ public:
     static Modules amodules;            // array of all modules
     static Dsymbols deferred;   // deferred Dsymbol's needing semantic() run on them
     static Dsymbols deferred3;  // deferred Dsymbol's needing semantic3() run on them
+#if IN_LLVM
+    static Dsymbols speculative3; // speculative template instances semantic3() was skipped for
+    static unsigned numSpeculativeSkipped;
+    static Dsymbols deferredDeps; // for each deferred Dsymbol, what it waits for (or NULL)
+    static unsigned numDeferredPasses;
+    static unsigned numDeferredRuns;
+    static unsigned numDeferredSkipped;
+    static unsigned numDeferrals; // number of addDeferredSemantic() calls
+#endif
     static unsigned dprogress;  // progress resolving the deferred list
     static void init();
 
@@ -168,11 +177,25 @@ public:
     Dsymbol *search(Loc loc, Identifier *ident, int flags = IgnoreNone);
     Dsymbol *symtabInsert(Dsymbol *s);
     void deleteObjFile();
+#if IN_LLVM
+    static void addDeferredSemantic(Dsymbol *s, Dsymbol *dep = NULL);
+#else
     static void addDeferredSemantic(Dsymbol *s);
+#endif
     static void runDeferredSemantic();
     static void addDeferredSemantic3(Dsymbol *s);
     static void runDeferredSemantic3();
+#if IN_LLVM
+    static bool skipSpeculative(Dsymbol *s);
+#endif
     static void clearCache();
+#if IN_LLVM
+    static void clearSourceDirCache();
+    static unsigned searchDepth;          // number of modules being searched
+    static unsigned searchCutoffDepth;    // min. insearch of modules skipped
+    static unsigned numFileProbes;        // source files looked for
+    static unsigned numFileProbesAvoided; // ... answered without a stat()
+#endif
     int imports(Module *m);
 
     bool isRoot() { return this->importedFrom == this; }
@@ -215,6 +238,9 @@ public:
     bool llvmForceLogging;
     bool noModuleInfo; /// Do not emit any module metadata.
 
+    // files read by import expressions in this module
+    Strings contentImportedFiles;
+
     // array ops emitted in this module already
     AA *arrayfuncs;
 
@@ -128,6 +128,9 @@ Type *Type::basic[TMAX];
 unsigned char Type::mangleChar[TMAX];
 unsigned short Type::sizeTy[TMAX];
 StringTable Type::stringtable;
+#if IN_LLVM
+StringTable Type::mergetable;
+#endif
 
 
 Type::Type(TY ty)
@@ -194,6 +197,9 @@ char Type::needThisPrefix()
 void Type::init()
 {
     stringtable._init(1543);
+#if IN_LLVM
+    mergetable._init(1543);
+#endif
     Lexer::initKeywords();
 
     for (size_t i = 0; i < TMAX; i++)
@@ -1741,6 +1747,55 @@ Lnot:
     return t;
 }
 
+#if IN_LLVM
+/* The deco of pointers, arrays, associative arrays and delegates only
+ * depends on the kind, the modifiers and the deco of their next (and
+ * index) type. As decos are interned, their addresses can stand in for the
+ * strings, so such types are looked up by this key first, instead of
+ * building their deco, which includes that of the whole chain of next types.
+ */
+struct MergeKey
+{
+    const char *next;
+    const char *index;
+    dinteger_t dim;
+    unsigned char ty;
+    unsigned char mod;
+};
+
+static bool getMergeKey(Type *t, MergeKey *key)
+{
+    // Zero the padding as well, the key is hashed as a whole.
+    memset(key, 0, sizeof(MergeKey));
+    switch (t->ty)
+    {
+        case Tsarray:
+        {
+            Expression *dim = ((TypeSArray *)t)->dim;
+            if (!dim || dim->op != TOKint64)
+                return false;
+            key->dim = dim->toInteger();
+            break;
+        }
+        case Taarray:
+            key->index = ((TypeAArray *)t)->index->merge()->deco;
+            break;
+        case Tpointer:
+        case Tarray:
+        case Tdelegate:
+            break;
+        default:
+            return false;
+    }
+    if (!t->nextOf())
+        return false;
+    key->next = t->nextOf()->deco;
+    key->ty = t->ty;
+    key->mod = t->mod;
+    return true;
+}
+#endif
+
 /************************************
  */
 
@@ -1760,6 +1815,16 @@ Type *Type::merge()
     assert(t);
     if (!deco)
     {
+#if IN_LLVM
+        MergeKey key;
+        bool hasKey = getMergeKey(this, &key);
+        if (hasKey)
+        {
+            StringValue *sv = mergetable.lookup((char *)&key, sizeof(key));
+            if (sv)
+                return (Type *)sv->ptrvalue;
+        }
+#endif
         OutBuffer buf;
         buf.reserve(32);
 
@@ -1782,6 +1847,10 @@ Type *Type::merge()
             deco = t->deco = (char *)sv->toDchars();
             //printf("new value, deco = '%s' %p\n", t->deco, t->deco);
         }
+#if IN_LLVM
+        if (hasKey)
+            mergetable.update((char *)&key, sizeof(key))->ptrvalue = t;
+#endif
     }
     return t;
 }
@@ -233,6 +233,9 @@ public:
     static unsigned char mangleChar[TMAX];
     static unsigned short sizeTy[TMAX];
     static StringTable stringtable;
+#if IN_LLVM
+    static StringTable mergetable;      // see Type::merge()
+#endif
 
     // These tables are for implicit conversion of binary ops;
     // the indices are the type of operand one, followed by operand two.
@@ -247,7 +247,11 @@ void *startthread(void *p)
     for (size_t i = 0; i < dim; i++)
     {   FileData *f = &aw->files[i];
 
+#if IN_LLVM
+        f->result = f->file->mmread();
+#else
         f->result = f->file->read();
+#endif
 
         // Set event
         int status = pthread_mutex_lock(&f->mutex);
@@ -321,7 +325,11 @@ void AsyncRead::start()
 int AsyncRead::read(size_t i)
 {
     FileData *f = &files[i];
+#if IN_LLVM && POSIX
+    f->result = f->file->mmread();
+#else
     f->result = f->file->read();
+#endif
     return f->result;
 }
 
@@ -31,6 +31,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <utime.h>
+#if IN_LLVM
+#include <sys/mman.h>
+#endif
 #endif
 
 #include "filename.h"
@@ -69,9 +72,9 @@ File::~File()
     {
         if (ref == 0)
             mem.free(buffer);
-#if _WIN32
+#if _WIN32 || (IN_LLVM && POSIX)
         if (ref == 2)
-            UnmapViewOfFile(buffer);
+            unmap();
 #endif
     }
     if (touchtime)
@@ -218,7 +221,52 @@ err1:
 
 int File::mmread()
 {
-#if POSIX
+#if POSIX && IN_LLVM
+    if (len)
+        return 0;               // already read the file
+
+    char *name = this->name->toChars();
+    int fd = open(name, O_RDONLY);
+    if (fd == -1)
+        return 1;
+
+    struct stat buf;
+    if (fstat(fd, &buf))
+    {
+        close(fd);
+        return 1;
+    }
+    size_t size = (size_t)buf.st_size;
+
+    /* The scanner needs two 0 bytes past the end of the buffer as sentinel.
+     * mmap() fills the rest of the last page with zeros, so they are there
+     * unless the file ends right at (or one byte before) a page boundary.
+     * Small files are cheaper to just read.
+     */
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t tail = size % pagesize;
+    if (size < 64 * 1024 || tail == 0 || tail > pagesize - 2)
+    {
+        close(fd);
+        return read();
+    }
+
+    // Private, writable mapping, as the buffer is handed out as mutable.
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return read();
+
+    if (!ref)
+        ::free(buffer);
+    ref = 2;
+    buffer = (unsigned char *)p;
+    len = size;
+
+    if (touchtime)
+        memcpy(touchtime, &buf, sizeof(buf));
+    return 0;
+#elif POSIX
     return read();
 #elif _WIN32
     HANDLE hFile;
@@ -265,6 +313,25 @@ Lerr:
 #endif
 }
 
+/*********************************************
+ * Release a buffer mapped by mmread().
+ */
+
+void File::unmap()
+{
+    assert(ref == 2);
+#if _WIN32
+    UnmapViewOfFile(buffer);
+#elif POSIX && IN_LLVM
+    munmap(buffer, len);
+#else
+    assert(0);
+#endif
+    buffer = NULL;
+    len = 0;
+    ref = 0;
+}
+
 /*********************************************
  * Write a file.
  * Returns:
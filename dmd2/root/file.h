@@ -48,6 +48,12 @@ struct File
 
     int mmread();
 
+    /* Release the buffer after a successful mmread() which mapped the
+     * file (ref == 2).
+     */
+
+    void unmap();
+
     /* Write file, return !=0 if error
      */
 
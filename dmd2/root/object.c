@@ -13,6 +13,10 @@
 
 /****************************** Object ********************************/
 
+#if IN_LLVM
+unsigned long long RootObject::numCreated = 0;
+#endif
+
 bool RootObject::equals(RootObject *o)
 {
     return o == this;
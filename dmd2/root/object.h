@@ -30,7 +30,14 @@ struct OutBuffer;
 class RootObject
 {
 public:
+#if IN_LLVM
+    RootObject() { ++numCreated; }
+
+    // Number of objects (AST nodes, identifiers, ...) created so far
+    static unsigned long long numCreated;
+#else
     RootObject() { }
+#endif
 
     virtual bool equals(RootObject *o);
 
@@ -16,67 +16,48 @@
 #include "rmem.h"                       // mem
 #include "stringtable.h"
 
-// TODO: Merge with root.String
-hash_t calcHash(const char *str, size_t len)
+#define POOL_SIZE (64 * 1024)
+
+/* MurmurHash2 by Austin Appleby (public domain), which hashes 4 bytes at a
+ * time and spreads the bits well enough for masking off the low bits.
+ */
+static hash_t calcHash(const char *str, size_t len)
 {
-    hash_t hash = 0;
+    const uint32_t m = 0x5bd1e995;
+    uint32_t h = 0x9747b28c ^ (uint32_t)len;
 
-    union
+    while (len >= 4)
     {
-        uint8_t  scratchB[4];
-        uint16_t scratchS[2];
-        uint32_t scratchI;
-    };
-    
-    while (1)
+        uint32_t k;
+        memcpy(&k, str, 4);
+        k *= m;
+        k ^= k >> 24;
+        k *= m;
+        h *= m;
+        h ^= k;
+        str += 4;
+        len -= 4;
+    }
+
+    switch (len)
     {
-        switch (len)
-        {
-            case 0:
-                return hash;
-
-            case 1:
-                hash *= 37;
-                hash += *(const uint8_t *)str;
-                return hash;
-
-            case 2:
-                hash *= 37;
-                scratchB[0] = str[0];
-                scratchB[1] = str[1];
-                hash += scratchS[0];
-                return hash;
-
-            case 3:
-                hash *= 37;
-                scratchB[0] = str[0];
-                scratchB[1] = str[1];
-                hash += (scratchS[0] << 8) +
-                        ((const uint8_t *)str)[2];
-                return hash;
-
-            default:
-                hash *= 37;
-                scratchB[0] = str[0];
-                scratchB[1] = str[1];
-                scratchB[2] = str[2];
-                scratchB[3] = str[3];
-                hash += scratchI;
-                str += 4;
-                len -= 4;
-                break;
-        }
+        case 3: h ^= ((const uint8_t *)str)[2] << 16;
+        case 2: h ^= ((const uint8_t *)str)[1] << 8;
+        case 1: h ^= ((const uint8_t *)str)[0];
+                h *= m;
     }
+
+    h ^= h >> 13;
+    h *= m;
+    h ^= h >> 15;
+    return h;
 }
 
-static int hashCmp(hash_t lhs, hash_t rhs)
+struct StringEntry
 {
-    if (lhs == rhs)
-        return 0;
-    else if (lhs < rhs)
-        return -1;
-    return 1;
-}
+    hash_t hash;
+    StringValue *value;         // NULL if the slot is empty
+};
 
 void StringValue::ctor(const char *p, size_t length)
 {
@@ -87,113 +68,150 @@ void StringValue::ctor(const char *p, size_t length)
 
 void StringTable::_init(size_t size)
 {
-    table = (void **)mem.calloc(size, sizeof(void *));
-    tabledim = size;
+    // Keep the load factor below 1/2.
+    tabledim = 16;
+    while (tabledim < size * 2)
+        tabledim *= 2;
+    table = (StringEntry *)mem.calloc(tabledim, sizeof(StringEntry));
     count = 0;
+
+    pools = NULL;
+    npools = 0;
+    poolused = POOL_SIZE;
 }
 
 StringTable::~StringTable()
 {
-    // Zero out dangling pointers to help garbage collector.
-    // Should zero out StringEntry's too.
-    for (size_t i = 0; i < count; i++)
-        table[i] = NULL;
+    for (size_t i = 0; i < npools; i++)
+        mem.free(pools[i]);
+    mem.free(pools);
+    pools = NULL;
+    npools = 0;
 
     mem.free(table);
     table = NULL;
+    tabledim = 0;
+    count = 0;
 }
 
-struct StringEntry
+StringValue *StringTable::allocValue(const char *s, size_t len)
 {
-    StringEntry *left;
-    StringEntry *right;
-    hash_t hash;
+    const size_t align = sizeof(void *);
+    size_t size = (sizeof(StringValue) + len + 1 + align - 1) & ~(align - 1);
 
-    StringValue value;
+    char *p;
+    if (size > POOL_SIZE / 4)
+    {
+        // Large strings get a pool of their own, without disturbing the
+        // current one.
+        p = (char *)mem.malloc(size);
+        pools = (char **)mem.realloc(pools, (npools + 1) * sizeof(char *));
+        if (npools)
+        {
+            pools[npools] = pools[npools - 1];
+            pools[npools - 1] = p;
+        }
+        else
+        {
+            pools[0] = p;
+            poolused = POOL_SIZE;
+        }
+        npools++;
+    }
+    else
+    {
+        if (poolused + size > POOL_SIZE)
+        {
+            pools = (char **)mem.realloc(pools, (npools + 1) * sizeof(char *));
+            pools[npools++] = (char *)mem.malloc(POOL_SIZE);
+            poolused = 0;
+        }
+        p = pools[npools - 1] + poolused;
+        poolused += size;
+    }
 
-    static StringEntry *alloc(const char *s, size_t len);
-};
+    StringValue *sv = (StringValue *)p;
+    sv->ptrvalue = NULL;
+    sv->ctor(s, len);
+    return sv;
+}
 
-StringEntry *StringEntry::alloc(const char *s, size_t len)
+/* Returns the index of the slot holding s, or of the empty slot where it
+ * belongs.
+ */
+size_t StringTable::findSlot(hash_t hash, const char *s, size_t len)
 {
-    StringEntry *se;
-
-    se = (StringEntry *) mem.calloc(1,sizeof(StringEntry) + len + 1);
-    se->value.ctor(s, len);
-    se->hash = calcHash(s,len);
-    return se;
+    const size_t mask = tabledim - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        StringEntry *se = &table[i];
+        if (!se->value)
+            return i;
+        if (se->hash == hash &&
+            se->value->len() == len &&
+            ::memcmp(s, se->value->toDchars(), len) == 0)
+            return i;
+    }
 }
 
-void **StringTable::search(const char *s, size_t len)
+void StringTable::grow()
 {
-    hash_t hash;
-    unsigned u;
-    int cmp;
-    StringEntry **se;
-
-    //printf("StringTable::search(%p,%d)\n",s,len);
-    hash = calcHash(s,len);
-    u = hash % tabledim;
-    se = (StringEntry **)&table[u];
-    //printf("\thash = %d, u = %d\n",hash,u);
-    while (*se)
+    const size_t odim = tabledim;
+    StringEntry *otable = table;
+
+    tabledim = odim * 2;
+    table = (StringEntry *)mem.calloc(tabledim, sizeof(StringEntry));
+    const size_t mask = tabledim - 1;
+    for (size_t i = 0; i < odim; i++)
     {
-        cmp = hashCmp((*se)->hash, hash);
-        if (cmp == 0)
-        {
-            cmp = (*se)->value.len() - len;
-            if (cmp == 0)
-            {
-                cmp = ::memcmp(s,(*se)->value.toDchars(),len);
-                if (cmp == 0)
-                    break;
-            }
-        }
-        if (cmp < 0)
-            se = &(*se)->left;
-        else
-            se = &(*se)->right;
+        if (!otable[i].value)
+            continue;
+        size_t j = otable[i].hash & mask;
+        while (table[j].value)
+            j = (j + 1) & mask;
+        table[j] = otable[i];
     }
-    //printf("\treturn %p, %p\n",se, (*se));
-    return (void **)se;
+    mem.free(otable);
 }
 
 StringValue *StringTable::lookup(const char *s, size_t len)
-{   StringEntry *se;
-
-    se = *(StringEntry **)search(s,len);
-    if (se)
-        return &se->value;
-    else
-        return NULL;
+{
+    size_t i = findSlot(calcHash(s, len), s, len);
+    return table[i].value;
 }
 
 StringValue *StringTable::update(const char *s, size_t len)
-{   StringEntry **pse;
-    StringEntry *se;
-
-    pse = (StringEntry **)search(s,len);
-    se = *pse;
-    if (!se)                    // not in table: so create new entry
+{
+    hash_t hash = calcHash(s, len);
+    size_t i = findSlot(hash, s, len);
+    if (!table[i].value)        // not in table: so create new entry
     {
-        se = StringEntry::alloc(s, len);
-        *pse = se;
+        if ((count + 1) * 2 > tabledim)
+        {
+            grow();
+            i = findSlot(hash, s, len);
+        }
+        table[i].hash = hash;
+        table[i].value = allocValue(s, len);
+        count++;
     }
-    return &se->value;
+    return table[i].value;
 }
 
 StringValue *StringTable::insert(const char *s, size_t len)
-{   StringEntry **pse;
-    StringEntry *se;
-
-    pse = (StringEntry **)search(s,len);
-    se = *pse;
-    if (se)
+{
+    hash_t hash = calcHash(s, len);
+    size_t i = findSlot(hash, s, len);
+    if (table[i].value)
         return NULL;            // error: already in table
-    else
+
+    if ((count + 1) * 2 > tabledim)
     {
-        se = StringEntry::alloc(s, len);
-        *pse = se;
+        grow();
+        i = findSlot(hash, s, len);
     }
-    return &se->value;
+    table[i].hash = hash;
+    table[i].value = allocValue(s, len);
+    count++;
+    return table[i].value;
 }
@@ -40,18 +40,26 @@ public:
     const char *toDchars() const { return lstring; }
 
 private:
-    friend struct StringEntry;
+    friend struct StringTable;
     StringValue();  // not constructible
     // This is more like a placement new c'tor
     void ctor(const char *p, size_t length);
 };
 
+/* Open addressing hash table with linear probing, which grows as needed.
+ * The values are allocated from pools and never move, so pointers to them
+ * stay valid for the lifetime of the table.
+ */
 struct StringTable
 {
 private:
-    void **table;
+    StringEntry *table;
+    size_t tabledim;            // always a power of 2
     size_t count;
-    size_t tabledim;
+
+    char **pools;
+    size_t npools;
+    size_t poolused;            // bytes used in the last pool
 
 public:
     void _init(size_t size = 37);
@@ -62,7 +70,9 @@ public:
     StringValue *update(const char *s, size_t len);
 
 private:
-    void **search(const char *s, size_t len);
+    size_t findSlot(hash_t hash, const char *s, size_t len);
+    StringValue *allocValue(const char *s, size_t len);
+    void grow();
 };
 
 #endif
@@ -790,7 +790,11 @@ void StructDeclaration::semantic(Scope *sc)
 
         scope = scx ? scx : sc->copy();
         scope->setNoFree();
+#if IN_LLVM
+        scope->module->addDeferredSemantic(this, fieldForwardRef());
+#else
         scope->module->addDeferredSemantic(this);
+#endif
 
         Module::dprogress = dprogress_save;
         //printf("\tdeferring %s\n", toChars());
@@ -968,6 +972,47 @@ void StructDeclaration::finalizeSize(Scope *sc)
     fill(loc, NULL, true);
 }
 
+#if IN_LLVM
+/***************************************
+ * Return the struct type of a field whose size is not known yet, i.e. what
+ * semantic() has to wait for after it failed due to a forward reference,
+ * or NULL if there is no such field.
+ */
+StructDeclaration *StructDeclaration::fieldForwardRef()
+{
+    struct FR
+    {
+        StructDeclaration *sd;
+
+        static int func(Dsymbol *s, void *param)
+        {
+            VarDeclaration *v = s->isVarDeclaration();
+            if (!v || !v->type ||
+                v->storage_class & (STCstatic | STCextern | STCtls | STCgshared | STCmanifest | STCctfe | STCtemplateparameter | STCref))
+                return 0;
+            Type *tv = v->type->baseElemOf();
+            if (tv->ty != Tstruct)
+                return 0;
+            StructDeclaration *sd = ((TypeStruct *)tv)->sym;
+            if (sd->sizeok == SIZEOKdone)
+                return 0;
+            ((FR *)param)->sd = sd;
+            return 1;
+        }
+    };
+    FR fr;
+    fr.sd = NULL;
+
+    for (size_t i = 0; i < members->dim; i++)
+    {
+        Dsymbol *s = (*members)[i];
+        if (s->apply(&FR::func, &fr))
+            break;
+    }
+    return fr.sd != this ? fr.sd : NULL;
+}
+#endif
+
 /***************************************
  * Fit elements[] to the corresponding type of field[].
  * Input:
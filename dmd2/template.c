@@ -36,6 +36,8 @@
 #include "attrib.h"
 
 #if IN_LLVM
+#include <time.h>
+#include "json.h"
 #include "gen/pragma.h"
 void DtoOverloadedIntrinsicName(TemplateInstance* ti, TemplateDeclaration* td, std::string& name);
 #endif
@@ -368,6 +370,115 @@ int arrayObjectMatch(Objects *oa1, Objects *oa2)
 }
 
 
+#if IN_LLVM
+/************************************
+ * Return hash of the value of a template value argument, which must follow
+ * the logic of the equals() overrides of the literal expressions.
+ * Expressions compared by identity hash to 0.
+ */
+static hash_t mixHash(hash_t h, hash_t v)
+{
+    return h * 31 + v;
+}
+
+static hash_t bytesHash(const void *p, size_t len)
+{
+    // FNV-1a
+    hash_t h = (hash_t)2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= ((const unsigned char *)p)[i];
+        h *= 16777619;
+    }
+    return h;
+}
+
+static hash_t realHash(real_t r)
+{
+    // Equal values have equal doubles, and all NaNs are equal.
+    double d = (double)r;
+    if (d == 0 || d != d)
+        return 0;
+    return bytesHash(&d, sizeof(d));
+}
+
+hash_t expressionHash(Expression *e)
+{
+    switch (e->op)
+    {
+        case TOKint64:
+            return (size_t)((IntegerExp *)e)->getInteger();
+
+        case TOKfloat64:
+            return realHash(((RealExp *)e)->value);
+
+        case TOKcomplex80:
+        {
+            ComplexExp *ce = (ComplexExp *)e;
+            return mixHash(realHash(creall(ce->value)), realHash(cimagl(ce->value)));
+        }
+
+        case TOKnull:
+            return 1;
+
+        case TOKstring:
+        {
+            StringExp *se = (StringExp *)e;
+            return mixHash(se->len, bytesHash(se->string, se->len * se->sz));
+        }
+
+        case TOKarrayliteral:
+        {
+            ArrayLiteralExp *ae = (ArrayLiteralExp *)e;
+            hash_t h = ae->elements->dim;
+            for (size_t i = 0; i < ae->elements->dim; i++)
+            {
+                Expression *el = (*ae->elements)[i];
+                h = mixHash(h, el ? expressionHash(el) : 0);
+            }
+            return h;
+        }
+
+        case TOKassocarrayliteral:
+        {
+            // The order of the entries does not matter.
+            AssocArrayLiteralExp *ae = (AssocArrayLiteralExp *)e;
+            hash_t h = ae->keys->dim;
+            for (size_t i = 0; i < ae->keys->dim; i++)
+                h += mixHash(expressionHash((*ae->keys)[i]), expressionHash((*ae->values)[i]));
+            return h;
+        }
+
+        case TOKstructliteral:
+        {
+            StructLiteralExp *sle = (StructLiteralExp *)e;
+            hash_t h = (size_t)sle->type->deco;
+            for (size_t i = 0; i < sle->elements->dim; i++)
+            {
+                Expression *el = (*sle->elements)[i];
+                h = mixHash(h, el ? expressionHash(el) : 0);
+            }
+            return h;
+        }
+
+        case TOKvar:
+            return (size_t)(void *)((VarExp *)e)->var;
+
+        case TOKtuple:
+        {
+            TupleExp *te = (TupleExp *)e;
+            hash_t h = te->e0 ? expressionHash(te->e0) : 0;
+            for (size_t i = 0; i < te->exps->dim; i++)
+                h = mixHash(h, expressionHash((*te->exps)[i]));
+            return h;
+        }
+
+        default:
+            return 0;
+    }
+}
+#endif
+
 /************************************
  * Return hash of Objects.
  */
@@ -387,11 +498,15 @@ hash_t arrayObjectHash(Objects *oa1)
             Expression *e1 = s1 ? getValue(s1) : getValue(isExpression(o1));
             if (e1)
             {
+#if IN_LLVM
+                hash += expressionHash(e1);
+#else
                 if (e1->op == TOKint64)
                 {
                     IntegerExp *ne = (IntegerExp *)e1;
                     hash += (size_t)ne->getInteger();
                 }
+#endif
             }
             else if (s1)
             {
@@ -517,6 +632,10 @@ TemplateDeclaration::TemplateDeclaration(Loc loc, Identifier *id,
     this->previous = NULL;
     this->protection = PROTundefined;
     this->numinstances = 0;
+#if IN_LLVM
+    this->numConstraintResults = 0;
+    this->stats = NULL;
+#endif
 
     // Compute in advance for Ddoc's use
     // Bugzilla 11153: ident could be NULL if parsing fails.
@@ -760,12 +879,159 @@ bool TemplateDeclaration::overloadInsert(Dsymbol *s)
     return true;
 }
 
+#if IN_LLVM
+/* The constraint of a template is typically evaluated for many candidates
+ * with the same arguments, e.g. when the same overloaded function template is
+ * called with the same argument types from many places. Its result is cached
+ * per TemplateDeclaration under the deduced arguments and, for function
+ * templates, the storage classes of the function parameters.
+ *
+ * This is only valid while the symbols the constraint looks at don't change.
+ * They do when imports or members are added (ScopeDsymbol::searchGeneration),
+ * and when an aggregate which was still being analysed is completed later on:
+ * e.g. is(typeof(S.sizeof)) is false while S has a forward reference. The
+ * latter shows as (possibly gagged) errors or as symbols deferred for later
+ * semantic analysis during the evaluation, which is then not cached.
+ */
+struct ConstraintResult
+{
+    ConstraintResult *next;     // next in the same bucket
+    hash_t hash;
+    Objects dedargs;
+    Array<StorageClass> fparamstc;
+    unsigned generation;        // ScopeDsymbol::searchGeneration
+    bool result;
+};
+
+unsigned TemplateDeclaration::numConstraintEvals;
+unsigned TemplateDeclaration::numConstraintHits;
+static unsigned constraintCutoffs;  // number of recursive evaluations refused
+
+/* The storage classes of the function parameters the constraint can observe,
+ * plus the modifiers of the function type (for 'this').
+ */
+static void constraintParamStc(FuncDeclaration *fd, Array<StorageClass> *stcs)
+{
+    if (!fd)
+        return;
+    TypeFunction *tf = (TypeFunction *)fd->type;
+    assert(tf->ty == Tfunction);
+    stcs->push(tf->mod | ((StorageClass)tf->varargs << 8));
+    size_t nfparams = Parameter::dim(tf->parameters);
+    for (size_t i = 0; i < nfparams; i++)
+    {
+        Parameter *fparam = Parameter::getNth(tf->parameters, i);
+        stcs->push(fparam->storageClass & (STCin | STCout | STCref | STClazy | STCfinal | STC_TYPECTOR | STCnodtor));
+    }
+}
+
+/****************************
+ * Check to see if constraint is satisfied, using the result of a previous
+ * evaluation with the same arguments if possible.
+ */
+bool TemplateDeclaration::evaluateConstraint(
+        TemplateInstance *ti, Scope *sc, Scope *paramscope,
+        Objects *dedargs, FuncDeclaration *fd)
+{
+    numConstraintEvals++;
+
+    Array<StorageClass> fparamstc;
+    constraintParamStc(fd, &fparamstc);
+    hash_t hash = arrayObjectHash(dedargs);
+    for (size_t i = 0; i < fparamstc.dim; i++)
+        hash = mixHash(hash, (hash_t)fparamstc[i]);
+
+    ConstraintResult **pbucket = NULL;
+    if (constraintCache.dim)
+    {
+        pbucket = &constraintCache[hash % constraintCache.dim];
+        for (ConstraintResult *cr = *pbucket; cr; cr = cr->next)
+        {
+            if (cr->hash == hash &&
+                cr->generation == ScopeDsymbol::searchGeneration &&
+                cr->fparamstc.dim == fparamstc.dim &&
+                memcmp(cr->fparamstc.tdata(), fparamstc.tdata(), fparamstc.dim * sizeof(StorageClass)) == 0 &&
+                arrayObjectMatch(&cr->dedargs, dedargs))
+            {
+                numConstraintHits++;
+                return cr->result;
+            }
+        }
+    }
+
+    unsigned errors = global.errors;
+    unsigned gaggedErrors = global.gaggedErrorsSeen;
+    unsigned deferrals = Module::numDeferrals;
+    unsigned cutoffs = constraintCutoffs;
+    unsigned generation = ScopeDsymbol::searchGeneration;
+    bool result = evaluateConstraintUncached(ti, sc, paramscope, dedargs, fd);
+
+    /* Don't cache results which came with diagnostics (gagged ones included,
+     * as those are gone from global.errors again), which ran into forward
+     * references, which were cut short by the detection of a recursive
+     * evaluation (which depends on the caller's scope), or during which
+     * imports or symbols were added.
+     */
+    if (errors != global.errors || gaggedErrors != global.gaggedErrorsSeen ||
+        deferrals != Module::numDeferrals || cutoffs != constraintCutoffs ||
+        generation != ScopeDsymbol::searchGeneration)
+        return result;
+
+    if (numConstraintResults >= constraintCache.dim)
+    {
+        // Rehash into twice as many buckets
+        size_t dim = constraintCache.dim ? constraintCache.dim * 2 : 4;
+        Array<ConstraintResult *> buckets;
+        buckets.setDim(dim);
+        buckets.zero();
+        for (size_t i = 0; i < constraintCache.dim; i++)
+        {
+            ConstraintResult *cr = constraintCache[i];
+            while (cr)
+            {
+                ConstraintResult *next = cr->next;
+                cr->next = buckets[cr->hash % dim];
+                buckets[cr->hash % dim] = cr;
+                cr = next;
+            }
+        }
+        constraintCache.setDim(dim);
+        memcpy(constraintCache.tdata(), buckets.tdata(), dim * sizeof(ConstraintResult *));
+    }
+    pbucket = &constraintCache[hash % constraintCache.dim];
+
+    ConstraintResult *cr = new ConstraintResult();
+    cr->hash = hash;
+    // dedargs may be modified by the caller afterwards
+    cr->dedargs.setDim(dedargs->dim);
+    memcpy(cr->dedargs.tdata(), dedargs->tdata(), dedargs->dim * sizeof(RootObject *));
+    cr->fparamstc.setDim(fparamstc.dim);
+    memcpy(cr->fparamstc.tdata(), fparamstc.tdata(), fparamstc.dim * sizeof(StorageClass));
+    cr->generation = generation;
+    cr->result = result;
+    cr->next = *pbucket;
+    *pbucket = cr;
+    numConstraintResults++;
+    return result;
+}
+
+void TemplateDeclaration::printConstraintCacheStatistics()
+{
+    fprintf(global.stdmsg, "template  %u of %u constraint evaluations cached\n",
+        numConstraintHits, numConstraintEvals);
+}
+
+bool TemplateDeclaration::evaluateConstraintUncached(
+        TemplateInstance *ti, Scope *sc, Scope *paramscope,
+        Objects *dedargs, FuncDeclaration *fd)
+#else
 /****************************
  * Check to see if constraint is satisfied.
  */
 bool TemplateDeclaration::evaluateConstraint(
         TemplateInstance *ti, Scope *sc, Scope *paramscope,
         Objects *dedargs, FuncDeclaration *fd)
+#endif
 {
     /* Detect recursive attempts to instantiate this template declaration,
      * Bugzilla 4072
@@ -791,7 +1057,12 @@ bool TemplateDeclaration::evaluateConstraint(
             for (Scope *scx = sc; scx; scx = scx->enclosing)
             {
                 if (scx == p->sc)
+                {
+#if IN_LLVM
+                    constraintCutoffs++;
+#endif
                     return false;
+                }
             }
         }
         /* BUG: should also check for ref param differences
@@ -2884,6 +3155,107 @@ PROT TemplateDeclaration::prot()
     return protection;
 }
 
+#if IN_LLVM
+/* -vtemplates: the instances of every template declaration are counted by
+ * findExistingInstance() and addInstance(), and TemplateInstance::semantic()
+ * records the CPU time spent and the number of objects created. The costs of
+ * nested instantiations are part of the totals of the outer ones, but not of
+ * their self costs.
+ */
+struct TemplateStats
+{
+    TemplateDeclaration *td;
+    unsigned instantiations;    // number of instances looked up
+    unsigned unique;            // number of instances created
+    unsigned deduplicated;      // number of lookups that found an instance
+    double time;                // seconds spent in semantic()
+    double selfTime;            // ... excluding nested instantiations
+    unsigned long long nodes;   // objects created by semantic()
+    unsigned long long selfNodes;
+};
+
+struct TemplateProfileFrame
+{
+    TemplateProfileFrame *prev;
+    TemplateInstance *ti;
+    double childTime;
+    unsigned long long childNodes;
+};
+
+static Array<TemplateStats *> allTemplateStats;
+static TemplateProfileFrame *templateProfileStack;
+
+static TemplateStats *templateStats(TemplateDeclaration *td)
+{
+    if (!td->stats)
+    {
+        td->stats = new TemplateStats();
+        td->stats->td = td;
+        allTemplateStats.push(td->stats);
+    }
+    return td->stats;
+}
+
+static int templateStatsCmp(const void *p1, const void *p2)
+{
+    TemplateStats *s1 = *(TemplateStats **)p1;
+    TemplateStats *s2 = *(TemplateStats **)p2;
+    if (s1->time != s2->time)
+        return s1->time < s2->time ? 1 : -1;
+    if (s1->instantiations != s2->instantiations)
+        return s1->instantiations < s2->instantiations ? 1 : -1;
+    return 0;
+}
+
+static void sortTemplateStats()
+{
+    qsort(allTemplateStats.tdata(), allTemplateStats.dim, sizeof(TemplateStats *), &templateStatsCmp);
+}
+
+/*******************************************
+ * Print the instantiation statistics to global.stdmsg, the most expensive
+ * templates first.
+ */
+void TemplateDeclaration::printTemplateStats()
+{
+    sortTemplateStats();
+    fprintf(global.stdmsg, "   time(s)    self(s)  instantiations    unique     nodes  template\n");
+    for (size_t i = 0; i < allTemplateStats.dim; i++)
+    {
+        TemplateStats *s = allTemplateStats[i];
+        fprintf(global.stdmsg, "%10.3f %10.3f %15u %9u %9llu  %s at %s\n",
+            s->time, s->selfTime, s->instantiations, s->unique, s->nodes,
+            s->td->toPrettyChars(), s->td->loc.toChars());
+    }
+}
+
+/*******************************************
+ * Write the instantiation statistics to buf as a JSON array, the most
+ * expensive templates first.
+ */
+void TemplateDeclaration::writeTemplateStatsJson(OutBuffer *buf)
+{
+    sortTemplateStats();
+    buf->writestring("[\n");
+    for (size_t i = 0; i < allTemplateStats.dim; i++)
+    {
+        TemplateStats *s = allTemplateStats[i];
+        buf->writestring(" {\n  \"name\" : ");
+        json_string(buf, s->td->toPrettyChars());
+        buf->writestring(",\n  \"location\" : ");
+        json_string(buf, s->td->loc.toChars());
+        buf->printf(",\n  \"instantiations\" : %u,\n  \"unique\" : %u,\n  \"deduplicated\" : %u",
+            s->instantiations, s->unique, s->deduplicated);
+        buf->printf(",\n  \"time\" : %.6f,\n  \"selfTime\" : %.6f",
+            s->time, s->selfTime);
+        buf->printf(",\n  \"nodes\" : %llu,\n  \"selfNodes\" : %llu\n }",
+            s->nodes, s->selfNodes);
+        buf->writestring(i + 1 < allTemplateStats.dim ? ",\n" : "\n");
+    }
+    buf->writestring("]\n");
+}
+#endif
+
 /****************************************************
  * Given a new instance tithis of this TemplateDeclaration,
  * see if there already exists an instance.
@@ -2894,6 +3266,10 @@ TemplateInstance *TemplateDeclaration::findExistingInstance(TemplateInstance *ti
 {
     tithis->fargs = fargs;
     hash_t hash = tithis->hashCode();
+#if IN_LLVM
+    if (global.params.vtemplates)
+        templateStats(this)->instantiations++;
+#endif
 
     if (!buckets.dim)
     {
@@ -2914,6 +3290,10 @@ TemplateInstance *TemplateDeclaration::findExistingInstance(TemplateInstance *ti
                 tithis->compare(ti) == 0)
             {
                 //printf("hash = %p yes %d n = %d\n", hash, instances->dim, numinstances);
+#if IN_LLVM
+                if (global.params.vtemplates)
+                    templateStats(this)->deduplicated++;
+#endif
                 return ti;
             }
         }
@@ -2967,6 +3347,10 @@ TemplateInstance *TemplateDeclaration::addInstance(TemplateInstance *ti)
         buckets[bi] = instances = new TemplateInstances();
     instances->push(ti);
     ++numinstances;
+#if IN_LLVM
+    if (global.params.vtemplates)
+        templateStats(this)->unique++;
+#endif
     return ti;
 }
 
@@ -5973,6 +6357,9 @@ TemplateInstance::TemplateInstance(Loc loc, Identifier *ident)
     this->enclosing = NULL;
     this->gagged = false;
     this->speculative = false;
+#if IN_LLVM
+    this->inSpeculative3 = false;
+#endif
     this->hash = 0;
     this->fargs = NULL;
 }
@@ -6004,6 +6391,9 @@ TemplateInstance::TemplateInstance(Loc loc, TemplateDeclaration *td, Objects *ti
     this->enclosing = NULL;
     this->gagged = false;
     this->speculative = false;
+#if IN_LLVM
+    this->inSpeculative3 = false;
+#endif
     this->hash = 0;
     this->fargs = NULL;
 
@@ -6116,7 +6506,56 @@ void TemplateInstance::trySemantic3(Scope *sc2)
     --nest;
 }
 
+#if IN_LLVM
 void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
+{
+    if (!global.params.vtemplates || inst)
+    {
+        semanticImpl(sc, fargs);
+        return;
+    }
+
+    TemplateProfileFrame frame;
+    frame.prev = templateProfileStack;
+    frame.ti = this;
+    frame.childTime = 0;
+    frame.childNodes = 0;
+    templateProfileStack = &frame;
+    clock_t start = clock();
+    unsigned long long startNodes = RootObject::numCreated;
+
+    semanticImpl(sc, fargs);
+
+    double time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    unsigned long long nodes = RootObject::numCreated - startNodes;
+    templateProfileStack = frame.prev;
+    if (frame.prev)
+    {
+        frame.prev->childTime += time;
+        frame.prev->childNodes += nodes;
+    }
+
+    TemplateDeclaration *td = tempdecl ? tempdecl->isTemplateDeclaration() : NULL;
+    if (!td)
+        return;
+    TemplateStats *stats = templateStats(td);
+    stats->selfTime += time - frame.childTime;
+    stats->selfNodes += nodes - frame.childNodes;
+
+    // Don't count recursive instantiations twice
+    for (TemplateProfileFrame *f = frame.prev; f; f = f->prev)
+    {
+        if (f->ti->tempdecl == td)
+            return;
+    }
+    stats->time += time;
+    stats->nodes += nodes;
+}
+
+void TemplateInstance::semanticImpl(Scope *sc, Expressions *fargs)
+#else
+void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
+#endif
 {
     //printf("TemplateInstance::semantic('%s', this=%p, gag = %d, sc = %p)\n", toChars(), this, global.gag, sc);
 #if 0
@@ -6231,6 +6670,9 @@ void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
             {
                 global.errors += inst->errors;
                 global.gaggedErrors += inst->errors;
+#if IN_LLVM
+                global.gaggedErrorsSeen += inst->errors;
+#endif
             }
 
             // If the first instantiation was gagged, but this is not:
@@ -6386,7 +6828,15 @@ void TemplateInstance::semantic(Scope *sc, Expressions *fargs)
         // Don't copy again so they were previously created.
     }
     else
+    {
+#if IN_LLVM
+        FuncDeclaration::shareBodies = true;
+        members = Dsymbol::arraySyntaxCopy(tempdecl->members);
+        FuncDeclaration::shareBodies = false;
+#else
         members = Dsymbol::arraySyntaxCopy(tempdecl->members);
+#endif
+    }
 
     // todo for TemplateThisParameter
     for (size_t i = 0; i < tempdecl->parameters->dim; i++)
@@ -8243,6 +8693,10 @@ bool TemplateInstance::needsCodegen()
         }
     }
 
+#if IN_LLVM
+    // Module::semantic3() skips these, unless for the cases above
+    return !isSpeculativeOnly();
+#else
     for (TemplateInstance *ti = this; ti; ti = ti->tinst)
     {
         //printf("\tti = %s spec = %d\n", ti->toChars(), ti->speculative);
@@ -8251,8 +8705,26 @@ bool TemplateInstance::needsCodegen()
     }
 
     return false;
+#endif
 }
 
+#if IN_LLVM
+/*****************************************
+ * Return true if this instance and all the instances it was instantiated
+ * from are speculative, i.e. if the instance has only been used inside
+ * __traits(compiles), is(typeof()) and the like so far.
+ */
+bool TemplateInstance::isSpeculativeOnly()
+{
+    for (TemplateInstance *ti = this; ti; ti = ti->tinst)
+    {
+        if (!ti->speculative)
+            return false;
+    }
+    return true;
+}
+#endif
+
 /* ======================== TemplateMixin ================================ */
 
 TemplateMixin::TemplateMixin(Loc loc, Identifier *ident, TypeQualified *tqual, Objects *tiargs)
@@ -8437,7 +8909,11 @@ void TemplateMixin::semantic(Scope *sc)
             symtab = sc->parent->isScopeDsymbol()->symtab;
         L1:
             assert(symtab);
+#if IN_LLVM
+            int num = (int)symtab->len() + 1;
+#else
             int num = (int)dmd_aaLen(symtab->tab) + 1;
+#endif
             ident = Lexer::uniqueId(s, num);
             symtab->insert(this);
         }
@@ -54,6 +54,9 @@ public:
     int dyncast() { return DYNCAST_TUPLE; }
 };
 
+struct ConstraintResult;
+struct TemplateStats;
+
 struct TemplatePrevious
 {
     TemplatePrevious *prev;
@@ -122,6 +125,22 @@ public:
 #if IN_LLVM
     // LDC
     std::string intrinsicName;
+
+    // Hash table of constraint results, see evaluateConstraint()
+    Array<ConstraintResult *> constraintCache;
+    size_t numConstraintResults;
+
+    static unsigned numConstraintEvals;
+    static unsigned numConstraintHits;
+    static void printConstraintCacheStatistics();
+
+    // Instantiation statistics for -vtemplates, NULL if none were collected
+    TemplateStats *stats;
+    static void printTemplateStats();
+    static void writeTemplateStatsJson(OutBuffer *buf);
+
+private:
+    bool evaluateConstraintUncached(TemplateInstance *ti, Scope *sc, Scope *paramscope, Objects *dedtypes, FuncDeclaration *fd);
 #endif
 };
 
@@ -342,6 +361,9 @@ public:
     // Note that these are inaccurate until semantic analysis phase completed.
     Module *instantiatingModule;        // the top module that instantiated this instance
     bool speculative;                   // if the instantiation is speculative
+#if IN_LLVM
+    bool inSpeculative3;                // if recorded in Module::speculative3
+#endif
 
     TemplateInstance(Loc loc, Identifier *temp_id);
     TemplateInstance(Loc loc, TemplateDeclaration *tempdecl, Objects *tiargs);
@@ -364,6 +386,9 @@ public:
     hash_t hashCode();
 
     bool needsCodegen();
+#if IN_LLVM
+    bool isSpeculativeOnly();
+#endif
 #if IN_DMD
     void toObjFile(bool multiobj);                       // compile to .obj file
 #endif
@@ -381,6 +406,9 @@ public:
     void expandMembers(Scope *sc);
     void tryExpandMembers(Scope *sc);
     void trySemantic3(Scope *sc2);
+#if IN_LLVM
+    void semanticImpl(Scope *sc, Expressions *fargs);
+#endif
 
     TemplateInstance *isTemplateInstance() { return this; }
     void accept(Visitor *v) { v->visit(this); }
@@ -0,0 +1,312 @@
+//===-- backendpool.cpp ---------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/backendpool.h"
+
+#include "mars.h"
+#include "root.h"
+#include "driver/splitmodule.h"
+#include "driver/targetmachine.h"
+#include "driver/toobj.h"
+#include "gen/irstate.h"
+#include "gen/logger.h"
+#include "gen/optimizer.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#if LDC_LLVM_VER >= 303
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#endif
+
+// Before LLVM 3.5, multi-threading had to be enabled explicitly at runtime and
+// we cannot rely on having a C++11 standard library. Just do the work serially
+// on the main thread in that case.
+#if LDC_LLVM_VER >= 305
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace {
+/// Reads back a module serialized using llvm::WriteBitcodeToFile() into the
+/// given context. Returns null and sets errorMsg on failure.
+llvm::Module *readBitcode(const std::string &bitcode,
+                          const std::string &filename,
+                          llvm::LLVMContext &context, std::string &errorMsg) {
+#if LDC_LLVM_VER >= 306
+    llvm::MemoryBufferRef buffer(bitcode, filename);
+#endif
+#if LDC_LLVM_VER >= 307
+    llvm::ErrorOr<std::unique_ptr<llvm::Module> > m =
+        llvm::parseBitcodeFile(buffer, context);
+#elif LDC_LLVM_VER >= 306
+    llvm::ErrorOr<llvm::Module *> m = llvm::parseBitcodeFile(buffer, context);
+#else
+    llvm::MemoryBuffer *buf =
+        llvm::MemoryBuffer::getMemBuffer(bitcode, filename, false);
+    llvm::ErrorOr<llvm::Module *> m = llvm::parseBitcodeFile(buf, context);
+    delete buf;
+#endif
+    if (!m) {
+        errorMsg = "cannot read back bitcode for '" + filename + "': " +
+                   m.getError().message();
+        return 0;
+    }
+#if LDC_LLVM_VER >= 307
+    return m->release();
+#else
+    return *m;
+#endif
+}
+
+struct Partition {
+    unsigned index;
+    std::string filename;
+    std::string errorMsg;
+};
+
+void emitPartition(const std::string &bitcode,
+                   const ldc::ModulePartitionPlan &plan, Partition &part,
+                   llvm::TargetMachine &target) {
+    llvm::LLVMContext context;
+    llvm::Module *m = readBitcode(bitcode, part.filename, context, part.errorMsg);
+    if (!m)
+        return;
+    ldc::extractModulePartition(*m, part.index, plan);
+    writeObjectFile(m, part.filename, target, part.errorMsg);
+    delete m;
+}
+}
+
+namespace ldc {
+
+struct BackendPool::Workers {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    // Signalled when a job is queued or shutdown is requested.
+    std::condition_variable jobQueued;
+    // Signalled when a worker has taken a job off the queue.
+    std::condition_variable jobTaken;
+
+    // All jobs in submission order. Finished jobs stay around until finish()
+    // so that their errors can be reported in order; a deque is used because
+    // the workers hold on to references into it while new jobs are appended.
+    std::deque<Job> jobs;
+    size_t nextJob;
+    bool shutdown;
+
+    Workers() : nextJob(0), shutdown(false) {}
+};
+
+bool BackendPool::isSupported() {
+    return llvm::llvm_is_multithreaded();
+}
+
+BackendPool::BackendPool(unsigned numThreads)
+    : numThreads_(numThreads), workers_(new Workers) {
+    assert(numThreads_ > 0);
+
+    // TargetMachine is not thread-safe, so every worker gets its own copy.
+    for (unsigned i = 0; i < numThreads_; ++i) {
+        targets_.push_back(cloneTargetMachine(*gTargetMachine));
+        workers_->threads.push_back(std::thread(&BackendPool::runJobs, this,
+                                                std::ref(*targets_[i])));
+    }
+}
+
+BackendPool::~BackendPool() {
+    assert(workers_->threads.empty() && "finish() not called");
+    delete workers_;
+    for (size_t i = 0; i < targets_.size(); ++i)
+        delete targets_[i];
+}
+
+void BackendPool::add(llvm::Module &m, const char *filename) {
+    // Serialize outside of the lock, the workers do not need it yet.
+    Job job;
+    job.filename = filename;
+    {
+        llvm::raw_string_ostream os(job.bitcode);
+        llvm::WriteBitcodeToFile(&m, os);
+    }
+
+    std::unique_lock<std::mutex> lock(workers_->mutex);
+    while (workers_->jobs.size() - workers_->nextJob >= numThreads_)
+        workers_->jobTaken.wait(lock);
+
+    workers_->jobs.push_back(Job());
+    workers_->jobs.back().filename.swap(job.filename);
+    workers_->jobs.back().bitcode.swap(job.bitcode);
+    workers_->jobQueued.notify_one();
+}
+
+void BackendPool::runJobs(llvm::TargetMachine &target) {
+    for (;;) {
+        Job *job;
+        {
+            std::unique_lock<std::mutex> lock(workers_->mutex);
+            while (workers_->nextJob == workers_->jobs.size() &&
+                   !workers_->shutdown) {
+                workers_->jobQueued.wait(lock);
+            }
+            if (workers_->nextJob == workers_->jobs.size())
+                return;
+            job = &workers_->jobs[workers_->nextJob++];
+            workers_->jobTaken.notify_one();
+        }
+
+        // Only this thread accesses the job until shutdown, so there is no
+        // need to hold the lock from here on.
+        llvm::LLVMContext context;
+        llvm::Module *m =
+            readBitcode(job->bitcode, job->filename, context, job->errorMsg);
+        if (m) {
+            writeModule(m, job->filename, target, job->errorMsg);
+            delete m;
+        }
+
+        // The bitcode is not needed anymore.
+        std::string().swap(job->bitcode);
+    }
+}
+
+void BackendPool::finish() {
+    {
+        std::lock_guard<std::mutex> lock(workers_->mutex);
+        workers_->shutdown = true;
+        workers_->jobQueued.notify_all();
+    }
+    for (size_t i = 0; i < workers_->threads.size(); ++i)
+        workers_->threads[i].join();
+    workers_->threads.clear();
+
+    bool failed = false;
+    for (size_t i = 0; i < workers_->jobs.size(); ++i) {
+        if (!workers_->jobs[i].errorMsg.empty()) {
+            error(Loc(), "%s", workers_->jobs[i].errorMsg.c_str());
+            failed = true;
+        }
+    }
+    workers_->jobs.clear();
+
+    if (failed)
+        fatal();
+}
+}
+
+namespace ldc {
+
+std::vector<std::string> writeModulePartitioned(llvm::Module &m,
+                                                const char *filename,
+                                                unsigned numPartitions) {
+    std::vector<std::string> filenames;
+
+    if (numPartitions < 2 || !BackendPool::isSupported() ||
+        Logger::enabled() || global.params.symdebug ||
+        !writesObjectFileOnly() || !canPartitionModule(m)) {
+        writeModule(&m, filename);
+        filenames.push_back(filename);
+        return filenames;
+    }
+
+    ldc_optimize_module(&m, *gTargetMachine);
+
+    // The names of the symbols made visible across partitions must not clash
+    // with those in other object files.
+    llvm::MD5 hash;
+    hash.update(filename);
+    llvm::MD5::MD5Result hashResult;
+    hash.final(hashResult);
+    llvm::SmallString<32> hashString;
+    llvm::MD5::stringifyResult(hashResult, hashString);
+
+    ModulePartitionPlan plan;
+    planModulePartitions(m, numPartitions,
+                         (".ldc.part." + hashString.substr(0, 8)).str(),
+                         plan);
+
+    std::string bitcode;
+    {
+        llvm::raw_string_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(&m, os);
+    }
+
+    std::vector<Partition> parts(numPartitions);
+    std::vector<llvm::TargetMachine *> targets;
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < numPartitions; ++i) {
+        parts[i].index = i;
+        if (i == 0) {
+            parts[i].filename = filename;
+        } else {
+            llvm::SmallString<128> name(FileName::removeExt(filename));
+            llvm::raw_svector_ostream(name) << '-' << i << '.'
+                                            << global.obj_ext;
+            parts[i].filename = name.str();
+        }
+
+        targets.push_back(cloneTargetMachine(*gTargetMachine));
+        threads.push_back(std::thread(emitPartition, std::cref(bitcode),
+                                      std::cref(plan), std::ref(parts[i]),
+                                      std::ref(*targets[i])));
+    }
+
+    bool failed = false;
+    for (unsigned i = 0; i < numPartitions; ++i) {
+        threads[i].join();
+        delete targets[i];
+        if (!parts[i].errorMsg.empty()) {
+            error(Loc(), "%s", parts[i].errorMsg.c_str());
+            failed = true;
+        }
+        filenames.push_back(parts[i].filename);
+    }
+    if (failed)
+        fatal();
+
+    return filenames;
+}
+}
+
+#else
+
+namespace ldc {
+
+bool BackendPool::isSupported() { return false; }
+
+BackendPool::BackendPool(unsigned numThreads)
+    : numThreads_(numThreads), workers_(0) {}
+
+BackendPool::~BackendPool() {}
+
+void BackendPool::add(llvm::Module &m, const char *filename) {
+    writeModule(&m, filename);
+}
+
+void BackendPool::finish() {}
+
+std::vector<std::string> writeModulePartitioned(llvm::Module &m,
+                                                const char *filename,
+                                                unsigned numPartitions) {
+    writeModule(&m, filename);
+    return std::vector<std::string>(1, filename);
+}
+}
+
+#endif
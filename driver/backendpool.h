@@ -0,0 +1,88 @@
+//===-- driver/backendpool.h - Parallel LLVM backend ------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Contains ldc::BackendPool, which runs the LLVM optimization and machine code
+// emission (i.e. writeModule()) for finished modules on a number of worker
+// threads. The workers start on a module as soon as it is handed over, so the
+// main thread can go on generating the IR for the next module in the meantime.
+//
+// The D frontend and the IR generation are not thread-safe and keep using the
+// global LLVMContext on the main thread. Every module handed to the pool is
+// serialized to bitcode and re-read into a private LLVMContext by the worker
+// which processes it, so no LLVM state is shared between threads.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_BACKENDPOOL_H
+#define LDC_DRIVER_BACKENDPOOL_H
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+class TargetMachine;
+}
+
+namespace ldc {
+
+class BackendPool {
+public:
+    /// Returns whether this LDC/LLVM combination supports running the backend
+    /// on more than one thread.
+    static bool isSupported();
+
+    explicit BackendPool(unsigned numThreads);
+    ~BackendPool();
+
+    /// Queues the given module to be written to filename. The module is copied,
+    /// so the caller can free it right after this returns.
+    ///
+    /// Blocks while there are already as many modules waiting as there are
+    /// worker threads, so that the IR generation cannot run arbitrarily far
+    /// ahead of the backend and pile up serialized modules in memory.
+    void add(llvm::Module &m, const char *filename);
+
+    /// Waits for all queued modules to be written and shuts down the workers.
+    ///
+    /// Errors are reported in the order the modules were added, independent of
+    /// the order the threads happened to finish them in.
+    void finish();
+
+private:
+    struct Job {
+        std::string filename;
+        std::string bitcode;
+        std::string errorMsg;
+    };
+
+    // Holds the threads and synchronization primitives, which are kept out of
+    // this header as they need C++11.
+    struct Workers;
+
+    void runJobs(llvm::TargetMachine &target);
+
+    unsigned const numThreads_;
+    Workers *workers_;
+    std::vector<llvm::TargetMachine *> targets_;
+};
+
+/// Optimizes m and emits it as numPartitions native object files, split by
+/// function, running the machine code generation for the partitions in
+/// parallel. Partition 0 is written to filename, the others to
+/// "<filename without extension>-<n>.<obj ext>".
+///
+/// Falls back to a plain writeModule() if the module or the requested output
+/// formats do not permit splitting. Returns the names of the files written.
+std::vector<std::string> writeModulePartitioned(llvm::Module &m,
+                                                const char *filename,
+                                                unsigned numPartitions);
+}
+
+#endif
@@ -424,6 +424,32 @@ cl::opt<bool> disableLinkerStripDead("disable-linker-strip-dead",
     cl::desc("Do not try to remove unused symbols during linking"),
     cl::init(false));
 
+cl::opt<unsigned> backendThreads("j",
+    cl::desc("Optimize and emit the generated modules on <n> threads"),
+    cl::value_desc("n"),
+    cl::Prefix,
+    cl::init(1));
+
+cl::opt<std::string> cacheDir("cache",
+    cl::desc("Reuse object files from previous compilations cached in <dir>"),
+    cl::value_desc("dir"));
+
+cl::opt<std::string> tokenCacheDir("token-cache",
+    cl::desc("Reuse the lexed tokens of imported modules cached in <dir>"),
+    cl::value_desc("dir"));
+
+cl::opt<bool> incrementalBuild("incremental",
+    cl::desc("Only recompile the modules affected by changes since the last compilation into the -od directory"));
+
+cl::opt<std::string> compileServer("compile-server",
+    cl::desc("Run as compile server for the clients started with LDC_COMPILE_SERVER=<path>"),
+    cl::value_desc("path"));
+
+cl::list<std::string> serverPreload("server-preload",
+    cl::desc("Modules to keep loaded in compile server mode"),
+    cl::value_desc("module1,module2,..."),
+    cl::CommaSeparated);
+
 cl::opt<bool, true> allinst("allinst",
     cl::desc("generate code for all template instantiations"),
     cl::location(global.params.allInst));
@@ -441,6 +467,24 @@ cl::opt<bool, true> vgc("vgc",
     cl::desc("list all gc allocations including hidden ones"),
     cl::location(global.params.vgc));
 
+cl::opt<bool> vtemplates("vtemplates",
+    cl::desc("print statistics about the instantiations of every template"));
+
+cl::opt<std::string> vtemplatesJson("vtemplates-json",
+    cl::desc("write statistics about the instantiations of every template to <file> as JSON"),
+    cl::value_desc("file"));
+
+cl::opt<bool> vctfeProfile("vctfe-profile",
+    cl::desc("print the time, calls, statements and allocations of every function evaluated at compile time"));
+
+cl::opt<std::string> vctfeProfileJson("vctfe-profile-json",
+    cl::desc("write the compile time function evaluation profile to <file> as JSON"),
+    cl::value_desc("file"));
+
+cl::opt<bool, true> ctfeArena("ctfe-arena",
+    cl::desc("(experimental) release the memory used by each compile time function evaluation once it is done"),
+    cl::location(global.params.ctfeArena));
+
 cl::opt<bool, true, FlagParser<bool> > color("color",
     cl::desc("Force colored console output"),
     cl::location(global.params.color));
@@ -76,6 +76,16 @@ namespace opts {
     extern cl::opt<bool, true> singleObj;
     extern cl::opt<bool> linkonceTemplates;
     extern cl::opt<bool> disableLinkerStripDead;
+    extern cl::opt<unsigned> backendThreads;
+    extern cl::opt<std::string> cacheDir;
+    extern cl::opt<std::string> tokenCacheDir;
+    extern cl::opt<bool> incrementalBuild;
+    extern cl::opt<std::string> compileServer;
+    extern cl::list<std::string> serverPreload;
+    extern cl::opt<bool> vtemplates;
+    extern cl::opt<std::string> vtemplatesJson;
+    extern cl::opt<bool> vctfeProfile;
+    extern cl::opt<std::string> vctfeProfileJson;
 
     extern BoundsCheck boundsCheck;
     extern bool nonSafeBoundsChecks;
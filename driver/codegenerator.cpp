@@ -13,7 +13,10 @@
 #include "mars.h"
 #include "module.h"
 #include "parse.h"
+#include "rmem.h"
 #include "scope.h"
+#include "driver/backendpool.h"
+#include "driver/incremental.h"
 #include "driver/toobj.h"
 #include "gen/logger.h"
 #include "gen/runtime.h"
@@ -83,14 +86,20 @@ void emitSymbolAddrGlobal(llvm::Module &lm, const char *symbolName,
 }
 
 namespace ldc {
-CodeGenerator::CodeGenerator(llvm::LLVMContext &context, bool singleObj)
-    : context_(context), moduleCount_(0), singleObj_(singleObj), ir_(0),
-      firstModuleObjfileName_(0) {
+CodeGenerator::CodeGenerator(llvm::LLVMContext &context, bool singleObj,
+                             unsigned backendThreads)
+    : context_(context), moduleCount_(0), singleObj_(singleObj),
+      backendThreads_(backendThreads), ir_(0), firstModuleObjfileName_(0),
+      backendPool_(0) {
     if (!ClassDeclaration::object) {
         error(Loc(), "declaration for class Object not found; druntime not "
                      "configured properly");
         fatal();
     }
+
+    if (backendThreads > 1 && !singleObj) {
+        backendPool_ = new BackendPool(backendThreads);
+    }
 }
 
 CodeGenerator::~CodeGenerator() {
@@ -110,6 +119,11 @@ CodeGenerator::~CodeGenerator() {
 
         writeAndFreeLLModule(filename);
     }
+
+    if (backendPool_) {
+        backendPool_->finish();
+        delete backendPool_;
+    }
 }
 
 void CodeGenerator::prepareLLModule(Module *m) {
@@ -140,6 +154,9 @@ void CodeGenerator::finishLLModule(Module *m) {
     if (singleObj_) return;
 
     m->deleteObjFile();
+    if (incremental::isEnabled()) {
+        incremental::recordSymbols(m, ir_->module);
+    }
     writeAndFreeLLModule(m->objfile->name->str);
 }
 
@@ -168,8 +185,20 @@ void CodeGenerator::writeAndFreeLLModule(const char *filename) {
     IdentMetadata->addOperand(llvm::MDNode::get(ir_->context(), IdentNode));
 #endif
 
-    writeModule(&ir_->module, filename);
-    global.params.objfiles->push(const_cast<char *>(filename));
+    if (singleObj_ && backendThreads_ > 1) {
+        std::vector<std::string> filenames =
+            writeModulePartitioned(ir_->module, filename, backendThreads_);
+        for (size_t i = 0; i < filenames.size(); ++i) {
+            global.params.objfiles->push(mem.strdup(filenames[i].c_str()));
+        }
+    } else {
+        if (backendPool_) {
+            backendPool_->add(ir_->module, filename);
+        } else {
+            writeModule(&ir_->module, filename);
+        }
+        global.params.objfiles->push(const_cast<char *>(filename));
+    }
     delete ir_;
     ir_ = 0;
 }
@@ -24,9 +24,17 @@
 
 namespace ldc {
 
+class BackendPool;
+
 class CodeGenerator {
 public:
-    CodeGenerator(llvm::LLVMContext &context, bool singleObj);
+    /// If backendThreads is larger than one, the LLVM optimization and object
+    /// emission runs on that many background threads, overlapping with the
+    /// IR generation for the following modules. For singleObj compilations,
+    /// the module is split into as many object files after optimization
+    /// instead.
+    CodeGenerator(llvm::LLVMContext &context, bool singleObj,
+                  unsigned backendThreads = 1);
     ~CodeGenerator();
     void emit(Module *m);
 
@@ -38,8 +46,10 @@ private:
     llvm::LLVMContext &context_;
     int moduleCount_;
     bool const singleObj_;
+    unsigned const backendThreads_;
     IRState *ir_;
     const char *firstModuleObjfileName_;
+    BackendPool *backendPool_;
 };
 }
 
@@ -0,0 +1,692 @@
+//===-- compileserver.cpp -------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/compileserver.h"
+
+#include "driver/cl_options.h"
+#include "lexer.h"
+#include "mars.h"
+#include "module.h"
+#include "rmem.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if LDC_POSIX
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+/// The module importing all preloaded modules, and the number of its members
+/// (the import declarations) before semantic analysis added any.
+Module *g_preloadModule = 0;
+size_t g_preloadImports = 0;
+
+bool g_served = false;
+
+#if LDC_POSIX
+const uint32_t protocolVersion = 1;
+
+/// Status sent back to the client if the server did not carry out the
+/// compilation.
+const int32_t declinedStatus = -1;
+
+/// Switches which are replaced by the values from the request.
+const char *const requestSwitches[] = { "-of", "-od", 0 };
+/// Switches which only concern the server itself.
+const char *const serverSwitches[] = { "-compile-server", "-server-preload", 0 };
+
+struct PreloadedFile {
+    std::string path;
+    std::string realPath;
+    time_t mtime;
+    off_t size;
+    std::string hash;
+};
+
+std::vector<PreloadedFile> g_preloadedFiles;
+std::vector<std::string> g_serverSwitches;
+std::string g_serverDir;
+
+bool hasPrefix(const char *arg, const char *const *prefixes) {
+    for (const char *const *p = prefixes; *p; ++p) {
+        if (strncmp(arg, *p, strlen(*p)) == 0)
+            return true;
+    }
+    return false;
+}
+
+/// Returns the switches from args which need to match between the server and
+/// a request, i.e. all except for the executable name, the input files and
+/// the output file names.
+std::vector<std::string> commonSwitches(const std::vector<const char *> &args,
+                                        const std::vector<std::string> &files) {
+    std::vector<std::string> result;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const char *arg = args[i];
+        if (hasPrefix(arg, requestSwitches) || hasPrefix(arg, serverSwitches))
+            continue;
+        if (std::find(files.begin(), files.end(), arg) != files.end())
+            continue;
+        result.push_back(arg);
+    }
+    return result;
+}
+
+std::string currentDir() {
+    char buf[PATH_MAX];
+    if (!getcwd(buf, sizeof(buf)))
+        return std::string();
+    return buf;
+}
+
+std::string realPath(const char *path) {
+    char buf[PATH_MAX];
+    if (!realpath(path, buf))
+        return std::string();
+    return buf;
+}
+
+bool hashFile(const char *path, std::string &result) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    llvm::MD5 hash;
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        hash.update(llvm::StringRef(buf, n));
+    bool const ok = !ferror(f);
+    fclose(f);
+    if (!ok)
+        return false;
+
+    llvm::MD5::MD5Result digest;
+    hash.final(digest);
+    llvm::SmallString<32> str;
+    llvm::MD5::stringifyResult(digest, str);
+    result.assign(str.begin(), str.end());
+    return true;
+}
+
+/// Returns whether any of the preloaded source files has been changed or
+/// removed. Files that were merely touched are updated to the new time stamp.
+bool preloadedFilesChanged() {
+    for (size_t i = 0; i < g_preloadedFiles.size(); ++i) {
+        PreloadedFile &f = g_preloadedFiles[i];
+        struct stat st;
+        if (stat(f.path.c_str(), &st) != 0 || st.st_size != f.size)
+            return true;
+        if (st.st_mtime == f.mtime)
+            continue;
+        std::string hash;
+        if (!hashFile(f.path.c_str(), hash) || hash != f.hash)
+            return true;
+        f.mtime = st.st_mtime;
+    }
+    return false;
+}
+
+void recordPreloadedFiles() {
+    for (size_t i = 0; i < Module::amodules.dim; ++i) {
+        Module *m = Module::amodules[i];
+        if (m == g_preloadModule)
+            continue;
+
+        PreloadedFile f;
+        f.path = m->srcfile->toChars();
+        f.realPath = realPath(f.path.c_str());
+        struct stat st;
+        if (stat(f.path.c_str(), &st) != 0 || !hashFile(f.path.c_str(), f.hash)) {
+            error(Loc(), "cannot read preloaded module file '%s'", f.path.c_str());
+            fatal();
+        }
+        f.mtime = st.st_mtime;
+        f.size = st.st_size;
+        g_preloadedFiles.push_back(f);
+    }
+}
+
+/// Loads and analyzes the given modules the same way as the imports of a root
+/// module, i.e. up to semantic2, plus semantic3 for the template instances
+/// they create.
+void preloadModules(const std::vector<std::string> &names) {
+    OutBuffer buf;
+    for (size_t i = 0; i < names.size(); ++i)
+        buf.printf("import %s;\n", names[i].c_str());
+    size_t const len = buf.offset;
+
+    Module *m = new Module("__ldc_preload.d", Lexer::idPool("__ldc_preload"),
+                           0, 0);
+    m->srcfile->setbuffer(buf.extractData(), len);
+    m->srcfile->ref = 1;
+    m->importedFrom = m;
+    Module::rootModule = m;
+    g_preloadModule = m;
+
+    if (global.params.verbose)
+        fprintf(global.stdmsg, "preload   %u modules\n",
+                static_cast<unsigned>(names.size()));
+
+    m->parse();
+    if (global.errors)
+        fatal();
+    g_preloadImports = m->members->dim;
+
+    m->importAll(0);
+    if (global.errors)
+        fatal();
+    m->semantic();
+    if (global.errors)
+        fatal();
+    Module::dprogress = 1;
+    Module::runDeferredSemantic();
+    m->semantic2();
+    if (global.errors)
+        fatal();
+    m->semantic3();
+    Module::runDeferredSemantic3();
+    if (global.errors)
+        fatal();
+}
+
+/// Returns whether the directory containing path is owned by the current user
+/// and inaccessible to anybody else.
+bool isPrivateDirectory(const char *path) {
+    std::string dir = llvm::sys::path::parent_path(path).str();
+    if (dir.empty())
+        dir = ".";
+    struct stat st;
+    return stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) &&
+           st.st_uid == getuid() && (st.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+}
+
+/// Returns whether the process at the other end of the connection runs as the
+/// current user.
+bool isPeerSameUser(int fd) {
+#ifdef SO_PEERCRED
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 ||
+        len != sizeof(cred)) {
+        return false;
+    }
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+int listenOn(const char *socketPath) {
+    sockaddr_un addr;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    // Replace the socket of a previous server instance. The socket is only
+    // accessible by the owner, who can make the server read any of their
+    // files (and import expressions do).
+    unlink(socketPath);
+    mode_t const oldMask = umask(S_IRWXG | S_IRWXO);
+    int const bound = bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    umask(oldMask);
+    if (bound != 0 || chmod(socketPath, S_IRUSR | S_IWUSR) != 0 ||
+        listen(fd, 16) != 0) {
+        int const err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int connectTo(const char *socketPath) {
+    sockaddr_un addr;
+    if (strlen(socketPath) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool readAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+/// Simple serialization of the request message, which never leaves the
+/// machine and thus uses the native byte order.
+class MessageWriter {
+public:
+    void putUInt(uint32_t value) {
+        data_.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    void putString(const std::string &str) {
+        putUInt(static_cast<uint32_t>(str.size()));
+        data_ += str;
+    }
+    void putStrings(const std::vector<std::string> &strs) {
+        putUInt(static_cast<uint32_t>(strs.size()));
+        for (size_t i = 0; i < strs.size(); ++i)
+            putString(strs[i]);
+    }
+    const std::string &data() const { return data_; }
+
+private:
+    std::string data_;
+};
+
+class MessageReader {
+public:
+    explicit MessageReader(const std::string &data)
+        : data_(data), pos_(0), ok_(true) {}
+
+    uint32_t getUInt() {
+        uint32_t value = 0;
+        if (pos_ + sizeof(value) > data_.size()) {
+            ok_ = false;
+            return 0;
+        }
+        memcpy(&value, data_.data() + pos_, sizeof(value));
+        pos_ += sizeof(value);
+        return value;
+    }
+    std::string getString() {
+        size_t const len = getUInt();
+        if (!ok_ || len > data_.size() - pos_) {
+            ok_ = false;
+            return std::string();
+        }
+        pos_ += len;
+        return data_.substr(pos_ - len, len);
+    }
+    std::vector<std::string> getStrings() {
+        std::vector<std::string> result;
+        uint32_t const n = getUInt();
+        for (uint32_t i = 0; ok_ && i < n; ++i)
+            result.push_back(getString());
+        return result;
+    }
+    bool ok() const { return ok_ && pos_ == data_.size(); }
+
+private:
+    const std::string &data_;
+    size_t pos_;
+    bool ok_;
+};
+
+/// Sends the message along with the client's stdout and stderr descriptors.
+bool sendRequest(int fd, const std::string &data) {
+    uint32_t size = static_cast<uint32_t>(data.size());
+    iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len = sizeof(size);
+
+    int const fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t n;
+    do
+        n = sendmsg(fd, &msg, 0);
+    while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(sizeof(size)) &&
+           writeAll(fd, data.data(), data.size());
+}
+
+/// Receives a message sent by sendRequest(). On success, outFds holds the
+/// client's stdout and stderr, which the caller needs to close.
+bool receiveRequest(int fd, std::string &data, int outFds[2]) {
+    uint32_t size = 0;
+    iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len = sizeof(size);
+
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do
+        n = recvmsg(fd, &msg, 0);
+    while (n < 0 && errno == EINTR);
+
+    cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : 0;
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        return false;
+    }
+    memcpy(outFds, CMSG_DATA(cmsg), 2 * sizeof(int));
+
+    // Requests are a few kilobytes at most.
+    if (n != static_cast<ssize_t>(sizeof(size)) || size > (1u << 24)) {
+        close(outFds[0]);
+        close(outFds[1]);
+        return false;
+    }
+    data.resize(size);
+    if (size && !readAll(fd, &data[0], size)) {
+        close(outFds[0]);
+        close(outFds[1]);
+        return false;
+    }
+    return true;
+}
+
+/// Decodes a request and checks whether it can be served from the preloaded
+/// state.
+bool parseRequest(const std::string &data, ldc::CompileRequest &request) {
+    MessageReader reader(data);
+    if (reader.getUInt() != protocolVersion)
+        return false;
+    std::string const dir = reader.getString();
+    std::vector<std::string> const switches = reader.getStrings();
+    request.files = reader.getStrings();
+    request.objectFile = reader.getString();
+    request.objectDir = reader.getString();
+    if (!reader.ok())
+        return false;
+
+    if (dir != g_serverDir || switches != g_serverSwitches ||
+        request.files.empty()) {
+        return false;
+    }
+
+    // A module cannot be both compiled and preloaded.
+    for (size_t i = 0; i < request.files.size(); ++i) {
+        std::string const path = realPath(request.files[i].c_str());
+        if (path.empty())
+            continue;
+        for (size_t j = 0; j < g_preloadedFiles.size(); ++j) {
+            if (g_preloadedFiles[j].realPath == path)
+                return false;
+        }
+    }
+    return true;
+}
+
+void reply(int fd, int32_t status) {
+    writeAll(fd, &status, sizeof(status));
+}
+
+/// Runs in a process forked off the server for one request. Forks again for
+/// the actual compilation, which returns from here, and reports its exit
+/// status to the client.
+void serveRequest(int fd, int outFds[2]) {
+    pid_t const pid = fork();
+    if (pid == 0) {
+        dup2(outFds[0], STDOUT_FILENO);
+        dup2(outFds[1], STDERR_FILENO);
+        close(outFds[0]);
+        close(outFds[1]);
+        close(fd);
+        return;
+    }
+
+    int32_t status = EXIT_FAILURE;
+    if (pid > 0) {
+        int wstatus;
+        pid_t res;
+        do
+            res = waitpid(pid, &wstatus, 0);
+        while (res < 0 && errno == EINTR);
+        if (res == pid && WIFEXITED(wstatus))
+            status = WEXITSTATUS(wstatus);
+    }
+    reply(fd, status);
+    _exit(EXIT_SUCCESS);
+}
+
+/// Replaces the server process by a fresh instance, which reloads the
+/// preloaded modules.
+void restart(int listenFd, const char *executable, char **argv) {
+    if (global.params.verbose)
+        fprintf(global.stdmsg, "server    preloaded modules changed, restarting\n");
+    close(listenFd);
+    fflush(stdout);
+    fflush(stderr);
+    execv(executable, argv);
+    error(Loc(), "cannot restart compile server: %s", strerror(errno));
+    fatal();
+}
+#endif
+}
+
+namespace ldc {
+
+int compileOnServer(const std::vector<const char *> &args,
+                    const Strings &sourceFiles) {
+#if LDC_POSIX
+    const char *socketPath = getenv("LDC_COMPILE_SERVER");
+    if (!socketPath || !*socketPath)
+        return -1;
+
+    // The server cannot run the program, and would not list the preloaded
+    // modules in the dependency file.
+    if (global.params.run || global.params.moduleDepsFile ||
+        sourceFiles.dim == 0) {
+        return -1;
+    }
+
+    std::vector<std::string> files;
+    for (size_t i = 0; i < sourceFiles.dim; ++i)
+        files.push_back(sourceFiles.data[i]);
+
+    MessageWriter msg;
+    msg.putUInt(protocolVersion);
+    msg.putString(currentDir());
+    msg.putStrings(commonSwitches(args, files));
+    msg.putStrings(files);
+    msg.putString(opts::objectFile);
+    msg.putString(opts::objectDir);
+
+    // The server gets our stdout and stderr.
+    int fd = connectTo(socketPath);
+    if (fd < 0)
+        return -1;
+    if (!isPeerSameUser(fd)) {
+        close(fd);
+        return -1;
+    }
+
+    // Keep the order of our and the server's output.
+    fflush(stdout);
+    fflush(stderr);
+
+    int32_t status = declinedStatus;
+    if (!sendRequest(fd, msg.data()) || !readAll(fd, &status, sizeof(status)))
+        status = declinedStatus;
+    close(fd);
+    return status;
+#else
+    return -1;
+#endif
+}
+
+void runCompileServer(const char *socketPath, const char *executable,
+                      char **argv, const std::vector<const char *> &args,
+                      const std::vector<std::string> &preload,
+                      CompileRequest &request) {
+#if LDC_POSIX
+    g_serverDir = currentDir();
+    g_serverSwitches = commonSwitches(args, std::vector<std::string>());
+
+    if (!isPrivateDirectory(socketPath)) {
+        error(Loc(), "the directory of compile server socket '%s' must only be "
+                     "accessible by its owner", socketPath);
+        fatal();
+    }
+
+    preloadModules(preload);
+    recordPreloadedFiles();
+
+    int const listenFd = listenOn(socketPath);
+    if (listenFd < 0) {
+        error(Loc(), "cannot listen on '%s': %s", socketPath, strerror(errno));
+        fatal();
+    }
+    if (global.params.verbose)
+        fprintf(global.stdmsg, "server    %s\n", socketPath);
+
+    // Clients may go away at any time, and the processes forked for the
+    // requests are not waited for.
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        int fd = accept(listenFd, 0, 0);
+        if (fd < 0)
+            continue;
+        if (!isPeerSameUser(fd)) {
+            close(fd);
+            continue;
+        }
+
+        std::string data;
+        int outFds[2];
+        if (!receiveRequest(fd, data, outFds)) {
+            close(fd);
+            continue;
+        }
+
+        bool const stale = preloadedFilesChanged();
+        if (stale || !parseRequest(data, request)) {
+            reply(fd, declinedStatus);
+            close(outFds[0]);
+            close(outFds[1]);
+            close(fd);
+            if (stale)
+                restart(listenFd, executable, argv);
+            continue;
+        }
+
+        // Do not inherit any buffered output.
+        fflush(stdout);
+        fflush(stderr);
+
+        if (fork() == 0) {
+            close(listenFd);
+            signal(SIGPIPE, SIG_DFL);
+            signal(SIGCHLD, SIG_DFL);
+            serveRequest(fd, outFds);
+
+            // This is the compilation process now.
+            g_served = true;
+            Module::rootModule = 0;
+            // Source files may have been added since the preloading.
+            Module::clearSourceDirCache();
+            return;
+        }
+        close(outFds[0]);
+        close(outFds[1]);
+        close(fd);
+    }
+#else
+    error(Loc(), "-compile-server is only supported on POSIX systems");
+    fatal();
+#endif
+}
+
+bool isServedCompilation() {
+    return g_served;
+}
+
+void adoptPreloadedModules() {
+    Module *root = Module::rootModule;
+    if (!g_served || !root)
+        return;
+
+    // Everything the preloaded modules instantiate from now on, and the
+    // preload module itself, belongs to the actual root module, as if it had
+    // imported them.
+    for (size_t i = 0; i < Module::amodules.dim; ++i) {
+        Module *m = Module::amodules[i];
+        if (m->importedFrom == g_preloadModule)
+            m->importedFrom = root;
+    }
+
+    Dsymbols *members = g_preloadModule->members;
+    for (size_t i = g_preloadImports; i < members->dim; ++i)
+        root->members->push((*members)[i]);
+    members->setDim(g_preloadImports);
+}
+}
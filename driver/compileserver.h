@@ -0,0 +1,86 @@
+//===-- driver/compileserver.h - Persistent compile server ------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A compile server keeps the commonly imported modules (object, core.*,
+// std.*, ...) loaded and semantically analyzed, so that a compiler invocation
+// does not need to start from scratch every time.
+//
+// The server is started with "-compile-server=<socket>" and the usual
+// compiler switches, but without any source files. It preloads the modules
+// given by -server-preload and then listens on the given Unix domain socket.
+// A compiler invoked with the environment variable LDC_COMPILE_SERVER set to
+// the socket path (which also covers ldmd2) sends its command line to the
+// server instead of compiling itself. The server forks a process per request,
+// which inherits the analyzed modules and carries out the compilation just as
+// if it had been started with the request's command line, writing to the
+// client's stdout/stderr.
+//
+// A request is only accepted if it was issued from the server's working
+// directory and all switches except for the input files and -of/-od are
+// identical to the server's, as the preloaded state depends on them. If a
+// preloaded source file has been modified since (checked by modification
+// time, and by content hash if only the time changed), the request is
+// declined and the server restarts itself to pick up the changes. Declined
+// requests and failed connections are compiled locally by the client.
+//
+// The socket has to be in a directory only accessible by its owner, and only
+// connections by processes of the same user are served.
+//
+// Only available on POSIX systems.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_COMPILESERVER_H
+#define LDC_DRIVER_COMPILESERVER_H
+
+#include "root.h"
+#include <string>
+#include <vector>
+
+namespace ldc {
+
+/// The per-invocation part of a compiler command line, which a compile server
+/// substitutes for its own.
+struct CompileRequest {
+    std::vector<std::string> files;
+    std::string objectFile;
+    std::string objectDir;
+};
+
+/// Sends the compilation to the server given by the LDC_COMPILE_SERVER
+/// environment variable, if any. args is the full command line (including the
+/// config file switches), sourceFiles the input files found therein.
+///
+/// Returns the exit status of the compilation, or -1 if it was not carried out
+/// by a server and needs to be done locally.
+int compileOnServer(const std::vector<const char *> &args,
+                    const Strings &sourceFiles);
+
+/// Preloads the given modules and serves compile requests on socketPath.
+/// executable and argv are used for restarting the server after a preloaded
+/// module has changed.
+///
+/// Only returns in the process forked for a request, with the request stored
+/// in request.
+void runCompileServer(const char *socketPath, const char *executable,
+                      char **argv, const std::vector<const char *> &args,
+                      const std::vector<std::string> &preload,
+                      CompileRequest &request);
+
+/// Returns whether this is a process forked by a compile server.
+bool isServedCompilation();
+
+/// Hands the preloaded modules over to the root modules of a served
+/// compilation, so that template instances created while preloading are
+/// considered for code generation just like in a normal compilation. Must be
+/// called after the root modules have been parsed.
+void adoptPreloadedModules();
+}
+
+#endif
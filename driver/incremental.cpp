@@ -0,0 +1,433 @@
+//===-- incremental.cpp ---------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/incremental.h"
+
+#include "module.h"
+#include "root.h"
+#include "scope.h"
+#include "hdrgen.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#if LDC_LLVM_VER >= 303
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/Module.h"
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+
+void toCBuffer(Module *m, OutBuffer *buf, HdrGenState *hgs);
+
+namespace {
+const char stateFileName[] = "ldc-incremental.state";
+const char stateFileHeader[] = "ldc-incremental 2";
+
+/// A file a module depends on, and the hash of its contents or interface.
+struct Dependency {
+    std::string path;
+    std::string hash;
+};
+
+/// The hashes of the template symbols an object file defines and of the ones
+/// it uses but which are defined in the object of another module.
+struct ObjectSymbols {
+    std::vector<std::string> defines;
+    std::vector<std::string> needs;
+};
+
+struct Record {
+    std::string object;
+    std::string sourceHash;
+    std::vector<Dependency> deps;
+    ObjectSymbols symbols;
+};
+
+/// Maps source file names to the state of their modules.
+typedef std::map<std::string, Record> Records;
+typedef std::set<std::string> SymbolSet;
+
+std::string g_stateFile;
+std::string g_key;
+Records g_previous;
+Records g_upToDate;
+std::map<Module *, std::string> g_sourceHashes;
+std::map<Module *, ObjectSymbols> g_symbols;
+// The dependency hashes, computed at most once per file.
+std::map<std::string, std::string> g_hashes;
+unsigned g_numModules = 0;
+
+std::string md5(llvm::StringRef data) {
+    llvm::MD5 hash;
+    hash.update(data);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> str;
+    llvm::MD5::stringifyResult(result, str);
+    return std::string(str.begin(), str.end());
+}
+
+std::string sourcePath(Module *m) {
+    return m->srcfile->toChars();
+}
+
+/// Returns the hash of the given dependency, i.e. of the interface of a
+/// root module or the contents of any other file, or an empty string if it
+/// cannot be read.
+std::string dependencyHash(const std::string &path) {
+    std::map<std::string, std::string>::iterator it = g_hashes.find(path);
+    if (it != g_hashes.end())
+        return it->second;
+
+    std::string hash;
+    File f(path.c_str());
+    if (!f.read()) {
+        hash = "src:" + md5(llvm::StringRef(
+                            reinterpret_cast<const char *>(f.buffer), f.len));
+    }
+    g_hashes[path] = hash;
+    return hash;
+}
+
+/// Collects the files m depends on: all transitively imported modules and
+/// the files read by import expressions in any of them.
+void collectDependencies(Module *m, std::vector<Dependency> &deps) {
+    std::set<Module *> seen;
+    std::set<std::string> files;
+    std::vector<Module *> worklist(1, m);
+    seen.insert(m);
+    while (!worklist.empty()) {
+        Module *mi = worklist.back();
+        worklist.pop_back();
+
+        if (mi != m)
+            files.insert(sourcePath(mi));
+        for (size_t i = 0; i < mi->contentImportedFiles.dim; ++i)
+            files.insert(mi->contentImportedFiles[i]);
+        for (size_t i = 0; i < mi->aimports.dim; ++i) {
+            if (seen.insert(mi->aimports[i]).second)
+                worklist.push_back(mi->aimports[i]);
+        }
+    }
+
+    for (std::set<std::string>::iterator I = files.begin(), E = files.end();
+         I != E; ++I) {
+        Dependency dep;
+        dep.path = *I;
+        dep.hash = dependencyHash(*I);
+        deps.push_back(dep);
+    }
+}
+
+bool isUpToDate(Module *m) {
+    Records::iterator it = g_previous.find(sourcePath(m));
+    if (it == g_previous.end())
+        return false;
+    const Record &rec = it->second;
+
+    if (rec.object != m->objfile->name->str ||
+        FileName::exists(rec.object.c_str()) != 1 ||
+        rec.sourceHash != g_sourceHashes[m]) {
+        return false;
+    }
+    for (size_t i = 0; i < rec.deps.size(); ++i) {
+        std::string const hash = dependencyHash(rec.deps[i].path);
+        if (hash.empty() || hash != rec.deps[i].hash)
+            return false;
+    }
+    return true;
+}
+
+/// Adds the external declarations and the template definitions (the only ones
+/// with weak_odr linkage) among the given globals to syms.
+template <class Iterator>
+void addSymbols(Iterator I, Iterator E, ObjectSymbols &syms) {
+    for (; I != E; ++I) {
+        if (I->hasLocalLinkage())
+            continue;
+        if (I->isDeclaration())
+            syms.needs.push_back(md5(I->getName()));
+        else if (I->hasWeakODRLinkage())
+            syms.defines.push_back(md5(I->getName()));
+    }
+}
+
+void addDefines(const Record &rec, SymbolSet &defines) {
+    defines.insert(rec.symbols.defines.begin(), rec.symbols.defines.end());
+}
+
+/// Template instances are only emitted into the object file of one of the
+/// modules using them. If an object relies on an instance that was previously
+/// emitted only into objects which are now recompiled, it might not be emitted
+/// anymore, so the object is out of date as well (and so on).
+void invalidateMovedSymbols(Modules &modules, std::vector<bool> &upToDate) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        SymbolSet available;
+        for (size_t i = 0; i < modules.dim; ++i) {
+            if (upToDate[i])
+                addDefines(g_previous[sourcePath(modules[i])], available);
+        }
+        for (size_t i = 0; i < modules.dim; ++i) {
+            if (!upToDate[i])
+                continue;
+            const ObjectSymbols &syms = g_previous[sourcePath(modules[i])].symbols;
+            for (size_t j = 0; j < syms.needs.size(); ++j) {
+                if (!available.count(syms.needs[j])) {
+                    upToDate[i] = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/// Reads the state file. Entries for a different command line are discarded.
+void readState() {
+    FILE *f = fopen(g_stateFile.c_str(), "r");
+    if (!f)
+        return;
+
+    // Every line is a tag followed by a space and a value (which may contain
+    // spaces itself): "key", then "module", "object", "source", and any
+    // number of "dep" and "hash", "define" and "need" lines per module.
+    Record *current = 0;
+    bool valid = false;
+    bool keyMatches = false;
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strlen(line);
+        if (len == 0 || line[len - 1] != '\n') {
+            valid = false;
+            break;
+        }
+        line[--len] = '\0';
+
+        if (!valid) {
+            valid = strcmp(line, stateFileHeader) == 0;
+            if (!valid)
+                break;
+            continue;
+        }
+
+        char *value = strchr(line, ' ');
+        if (!value) {
+            valid = false;
+            break;
+        }
+        *value++ = '\0';
+
+        if (strcmp(line, "key") == 0) {
+            keyMatches = g_key == value;
+            if (!keyMatches)
+                break;
+        } else if (strcmp(line, "module") == 0) {
+            current = &g_previous[value];
+        } else if (current && strcmp(line, "object") == 0) {
+            current->object = value;
+        } else if (current && strcmp(line, "source") == 0) {
+            current->sourceHash = value;
+        } else if (current && strcmp(line, "dep") == 0) {
+            current->deps.push_back(Dependency());
+            current->deps.back().path = value;
+        } else if (current && !current->deps.empty() &&
+                   strcmp(line, "hash") == 0) {
+            current->deps.back().hash = value;
+        } else if (current && strcmp(line, "define") == 0) {
+            current->symbols.defines.push_back(value);
+        } else if (current && strcmp(line, "need") == 0) {
+            current->symbols.needs.push_back(value);
+        } else {
+            valid = false;
+            break;
+        }
+    }
+    fclose(f);
+
+    if (!valid || !keyMatches)
+        g_previous.clear();
+}
+
+bool writeState(const Records &records) {
+    std::string const tmpFile = g_stateFile + ".tmp";
+    FILE *f = fopen(tmpFile.c_str(), "w");
+    if (!f)
+        return false;
+
+    fprintf(f, "%s\nkey %s\n", stateFileHeader, g_key.c_str());
+    for (Records::const_iterator I = records.begin(), E = records.end();
+         I != E; ++I) {
+        const Record &rec = I->second;
+        fprintf(f, "module %s\nobject %s\nsource %s\n", I->first.c_str(),
+                rec.object.c_str(), rec.sourceHash.c_str());
+        for (size_t i = 0; i < rec.deps.size(); ++i) {
+            fprintf(f, "dep %s\nhash %s\n", rec.deps[i].path.c_str(),
+                    rec.deps[i].hash.c_str());
+        }
+        for (size_t i = 0; i < rec.symbols.defines.size(); ++i)
+            fprintf(f, "define %s\n", rec.symbols.defines[i].c_str());
+        for (size_t i = 0; i < rec.symbols.needs.size(); ++i)
+            fprintf(f, "need %s\n", rec.symbols.needs[i].c_str());
+    }
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmpFile.c_str(), g_stateFile.c_str()) != 0) {
+        remove(tmpFile.c_str());
+        return false;
+    }
+    return true;
+}
+}
+
+namespace incremental {
+
+void init(const char *objdir, const std::vector<const char *> &args,
+          const Strings &sourceFiles) {
+    llvm::SmallString<128> path(objdir);
+    llvm::sys::path::append(path, stateFileName);
+    g_stateFile.assign(path.begin(), path.end());
+
+    // Skip the executable name. Source files may be added or removed without
+    // affecting the other modules.
+    std::string commandLine;
+    for (size_t i = 1; i < args.size(); ++i) {
+        bool isSource = false;
+        for (size_t j = 0; j < sourceFiles.dim && !isSource; ++j)
+            isSource = strcmp(args[i], sourceFiles.data[j]) == 0;
+        if (isSource || strcmp(args[i], "-v") == 0)
+            continue;
+        commandLine += args[i];
+        commandLine += '\0';
+    }
+    g_key = md5(commandLine + global.ldc_version + '\0' + global.llvm_version);
+
+    readState();
+}
+
+bool isEnabled() {
+    return !g_stateFile.empty();
+}
+
+void addSource(Module *m) {
+    g_sourceHashes[m] = md5(llvm::StringRef(
+        reinterpret_cast<const char *>(m->srcfile->buffer), m->srcfile->len));
+}
+
+void removeUpToDateModules(Modules &modules) {
+    // The interfaces of all root modules are known from the parsed source.
+    for (size_t i = 0; i < modules.dim; ++i) {
+        OutBuffer buf;
+        HdrGenState hgs;
+        toCBuffer(modules[i], &buf, &hgs);
+        g_hashes[sourcePath(modules[i])] = "ast:" + md5(llvm::StringRef(
+            reinterpret_cast<const char *>(buf.data), buf.offset));
+    }
+
+    g_numModules = modules.dim;
+    std::vector<bool> upToDate(modules.dim);
+    for (size_t i = 0; i < modules.dim; ++i)
+        upToDate[i] = isUpToDate(modules[i]);
+    invalidateMovedSymbols(modules, upToDate);
+
+    for (size_t i = 0, j = 0; j < upToDate.size(); ++j) {
+        Module *m = modules[i];
+        if (!upToDate[j]) {
+            m->deleteObjFile();
+            ++i;
+            continue;
+        }
+
+        g_upToDate[sourcePath(m)] = g_previous[sourcePath(m)];
+        global.params.objfiles->push(m->objfile->name->str);
+
+        // The module is just an import now, in case one of the modules to be
+        // compiled depends on it.
+        m->importedFrom = NULL;
+        modules.remove(i);
+    }
+}
+
+void recordSymbols(Module *m, llvm::Module &lm) {
+    ObjectSymbols &syms = g_symbols[m];
+    addSymbols(lm.begin(), lm.end(), syms);
+    addSymbols(lm.global_begin(), lm.global_end(), syms);
+}
+
+void saveState(Modules &modules) {
+    Records records = g_upToDate;
+    for (size_t i = 0; i < modules.dim; ++i) {
+        Module *m = modules[i];
+        Record &rec = records[sourcePath(m)];
+        rec.object = m->objfile->name->str;
+        rec.sourceHash = g_sourceHashes[m];
+        collectDependencies(m, rec.deps);
+        rec.symbols = g_symbols[m];
+    }
+
+    // Check that the new objects did not lose any template instance they need
+    // to a skipped object, which could happen if the instance is attributed
+    // to one of the skipped modules during semantic analysis. The next
+    // compilation needs to start from scratch then.
+    SymbolSet defines, previousDefines;
+    for (Records::const_iterator I = records.begin(), E = records.end();
+         I != E; ++I) {
+        addDefines(I->second, defines);
+    }
+    for (Records::const_iterator I = g_previous.begin(), E = g_previous.end();
+         I != E; ++I) {
+        addDefines(I->second, previousDefines);
+    }
+    for (size_t i = 0; i < modules.dim; ++i) {
+        const ObjectSymbols &syms = g_symbols[modules[i]];
+        for (size_t j = 0; j < syms.needs.size(); ++j) {
+            if (previousDefines.count(syms.needs[j]) &&
+                !defines.count(syms.needs[j])) {
+                warning(Loc(), "template instances used by '%s' moved to "
+                               "modules not recompiled; the next compilation "
+                               "rebuilds all modules",
+                        sourcePath(modules[i]).c_str());
+                remove(g_stateFile.c_str());
+                return;
+            }
+        }
+    }
+
+    // Only the needed symbols defined by one of the objects are of interest,
+    // not those from libraries.
+    for (Records::iterator I = records.begin(), E = records.end(); I != E;
+         ++I) {
+        std::vector<std::string> &needs = I->second.symbols.needs;
+        std::vector<std::string> kept;
+        for (size_t j = 0; j < needs.size(); ++j) {
+            if (defines.count(needs[j]))
+                kept.push_back(needs[j]);
+        }
+        needs.swap(kept);
+    }
+
+    if (!writeState(records))
+        warning(Loc(), "cannot write incremental compilation state to '%s'",
+                g_stateFile.c_str());
+}
+
+void printStatistics() {
+    fprintf(global.stdmsg, "incremental  %u of %u modules up to date\n",
+            static_cast<unsigned>(g_upToDate.size()), g_numModules);
+}
+}
@@ -0,0 +1,82 @@
+//===-- driver/incremental.h - Incremental rebuilds -------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Support for -incremental, which skips the semantic analysis and code
+// generation for source files whose object file from a previous compilation
+// into the same -od directory is still up to date.
+//
+// The state of the last compilation is stored in the object directory. For
+// every root module, it records the object file, a hash of the source file
+// and the modules it transitively imports along with hashes of their
+// interfaces. A module is up to date if neither its own source nor the
+// interface of any of those imports changed, and if the command line switches
+// are the same as last time.
+//
+// The interface of a module that is compiled (or skipped) in the same
+// invocation is taken to be its pretty-printed AST. This ignores changes to
+// comments and formatting, but includes all function bodies, as any of them
+// could be evaluated by CTFE or inlined into the importing module. Other
+// imports (e.g. from libraries) are compared by their source file contents.
+//
+// A template instance is only emitted into the object file of one of the root
+// modules using it. The state thus also lists the template symbols each object
+// defines and the ones it needs from other objects. An object that needs an
+// instance which was previously only defined by objects that are recompiled
+// now is out of date as well, as the instance might not be emitted anymore.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_INCREMENTAL_H
+#define LDC_DRIVER_INCREMENTAL_H
+
+#include "arraytypes.h"
+#include "mars.h"
+#include <vector>
+
+namespace llvm {
+class Module;
+}
+
+namespace incremental {
+
+/// Enables incremental compilation, keeping the state in objdir. args are the
+/// command line switches the compiler was invoked with, and sourceFiles the
+/// source files given therein.
+void init(const char *objdir, const std::vector<const char *> &args,
+          const Strings &sourceFiles);
+
+/// Returns whether incremental compilation is enabled.
+bool isEnabled();
+
+/// Records the hash of the source file of the root module m, which must have
+/// been read but not yet parsed.
+void addSource(Module *m);
+
+/// Removes the root modules whose object files are still up to date from
+/// modules, and adds those object files to global.params.objfiles. The
+/// existing output files of the remaining modules are deleted.
+///
+/// Must be called after the root modules have been parsed, but before any
+/// semantic analysis.
+void removeUpToDateModules(Modules &modules);
+
+/// Records the symbols defined and used by the object file of the root module
+/// m, whose IR is in lm.
+void recordSymbols(Module *m, llvm::Module &lm);
+
+/// Writes the state for the next compilation, after the given modules have
+/// been compiled successfully.
+void saveState(Modules &modules);
+
+/// Prints the number of modules which did not need to be recompiled to
+/// global.stdmsg.
+void printStatistics();
+}
+
+#endif
@@ -8,7 +8,10 @@
 //===----------------------------------------------------------------------===//
 
 #include "module.h"
+#include "async.h"
 #include "color.h"
+#include "expression.h"
+#include "ctfe.h"
 #include "doc.h"
 #include "id.h"
 #include "hdrgen.h"
@@ -19,13 +22,19 @@
 #include "rmem.h"
 #include "root.h"
 #include "scope.h"
+#include "template.h"
 #include "dmd2/target.h"
+#include "driver/backendpool.h"
 #include "driver/cl_options.h"
 #include "driver/codegenerator.h"
+#include "driver/compileserver.h"
 #include "driver/configfile.h"
+#include "driver/incremental.h"
 #include "driver/ldc-version.h"
 #include "driver/linker.h"
+#include "driver/objcache.h"
 #include "driver/targetmachine.h"
+#include "driver/tokencache.h"
 #include "gen/cl_helpers.h"
 #include "gen/irstate.h"
 #include "gen/linkage.h"
@@ -254,12 +263,15 @@ static void hideLLVMOptions() {
 #endif
 
 int main(int argc, char **argv);
+static void initOutputFiles(Strings &sourceFiles);
 
 /// Parses switches from the command line, any response files and the global
 /// config file and sets up global.params accordingly.
 ///
-/// Returns a list of source file names.
-static void parseCommandLine(int argc, char **argv, Strings &sourceFiles, bool &helpOnly) {
+/// Returns the combined list of arguments and a list of source file names.
+static void parseCommandLine(int argc, char **argv,
+                             std::vector<const char*> &final_args,
+                             Strings &sourceFiles, bool &helpOnly) {
 #if _WIN32
     char buf[MAX_PATH];
     GetModuleFileName(NULL, buf, MAX_PATH);
@@ -285,7 +297,6 @@ static void parseCommandLine(int argc, char **argv, Strings &sourceFiles, bool &
     global.params.moduleDepsFile = NULL;
 
     // Build combined list of command line arguments.
-    std::vector<const char*> final_args;
     final_args.push_back(argv[0]);
 
     ConfigFile cfg_file;
@@ -309,6 +320,13 @@ static void parseCommandLine(int argc, char **argv, Strings &sourceFiles, bool &
     helpOnly = mCPU == "help" ||
         (std::find(mAttrs.begin(), mAttrs.end(), "help") != mAttrs.end());
 
+    if (!cacheDir.empty())
+        objcache::init(cacheDir.c_str(), final_args);
+    if (!tokenCacheDir.empty())
+        TokenCache::init(tokenCacheDir.c_str());
+    global.params.vtemplates = vtemplates || !vtemplatesJson.empty();
+    global.params.vctfeProfile = vctfeProfile || !vctfeProfileJson.empty();
+
     // Print some information if -v was passed
     // - path to compiler binary
     // - version number
@@ -436,6 +454,13 @@ static void parseCommandLine(int argc, char **argv, Strings &sourceFiles, bool &
     if (opts::boundsCheck != opts::BC_Default)
         global.params.useArrayBounds = opts::boundsCheck;
 
+    initOutputFiles(sourceFiles);
+}
+
+/// Determines the output files and formats from global.params.objname and the
+/// source files. Called again with the files of every request served by a
+/// compile server.
+static void initOutputFiles(Strings &sourceFiles) {
     // LDC output determination
 
     // if we don't link, autodetect target from extension
@@ -500,6 +525,22 @@ static void parseCommandLine(int argc, char **argv, Strings &sourceFiles, bool &
     if (soname.getNumOccurrences() > 0 && !createSharedLib) {
         error(Loc(), "-soname can be used only when building a shared library");
     }
+
+    if (backendThreads == 0) {
+        error(Loc(), "-j requires at least one thread");
+    } else if (backendThreads > 1) {
+        // The logger is not thread-safe, and its output would be interleaved
+        // anyway.
+        if (!ldc::BackendPool::isSupported() || Logger::enabled())
+            backendThreads = 1;
+
+        // With -singleobj, -j splits the module into several object files,
+        // which is only transparent if they are linked or archived right away.
+        if (singleObj && (!(global.params.link || createStaticLib) ||
+                          global.params.run)) {
+            backendThreads = 1;
+        }
+    }
 }
 
 static void initializePasses() {
@@ -908,6 +949,18 @@ static void emitJson(Modules &modules)
     }
 }
 
+static void emitStatsJson(const char *name, void (*write)(OutBuffer *))
+{
+    OutBuffer buf;
+    write(&buf);
+
+    ensurePathToNameExists(Loc(), name);
+    File *file = new File(name);
+    file->setbuffer(buf.data, buf.offset);
+    file->ref = 1;
+    writeFile(Loc(), file);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -930,10 +983,16 @@ int main(int argc, char **argv)
     initializePasses();
 
     bool helpOnly;
+    std::vector<const char*> final_args;
     Strings files;
-    parseCommandLine(argc, argv, files, helpOnly);
+    parseCommandLine(argc, argv, final_args, files, helpOnly);
 
-    if (files.dim == 0 && !helpOnly)
+    if (!compileServer.empty())
+    {
+        if (files.dim != 0 || !objectFile.empty() || !objectDir.empty())
+            error(Loc(), "-compile-server does not take any input or output files");
+    }
+    else if (files.dim == 0 && !helpOnly)
     {
         cl::PrintHelpMessage();
         return EXIT_FAILURE;
@@ -942,6 +1001,13 @@ int main(int argc, char **argv)
     if (global.errors)
         fatal();
 
+    if (compileServer.empty() && !helpOnly)
+    {
+        int status = ldc::compileOnServer(final_args, files);
+        if (status >= 0)
+            return status;
+    }
+
     // Set up the TargetMachine.
     ExplicitBitness::Type bitness = ExplicitBitness::None;
     if ((m32bits || m64bits) && (!mArch.empty() || !mTargetTriple.empty()))
@@ -1045,6 +1111,37 @@ int main(int argc, char **argv)
         }
     }
 
+    if (!compileServer.empty())
+    {
+        // Only returns in the processes forked for the compile requests.
+        ldc::CompileRequest request;
+        ldc::runCompileServer(compileServer.c_str(),
+            llvm::sys::fs::getMainExecutable(argv[0], (void*)main).c_str(),
+            argv, final_args, serverPreload, request);
+
+        if (!request.objectFile.empty())
+            global.params.objname = mem.strdup(request.objectFile.c_str());
+        if (!request.objectDir.empty())
+            global.params.objdir = mem.strdup(request.objectDir.c_str());
+        for (size_t i = 0; i < request.files.size(); i++)
+            files.push(mem.strdup(request.files[i].c_str()));
+        initOutputFiles(files);
+        if (global.errors)
+            fatal();
+    }
+
+    if (incrementalBuild)
+    {
+        if (!global.params.objdir)
+            error(Loc(), "-incremental requires -od");
+        else if (singleObj || global.params.run || global.params.doJsonGeneration)
+            error(Loc(), "-incremental cannot be used together with -singleobj, -run or -X");
+        else
+            incremental::init(global.params.objdir, final_args, files);
+        if (global.errors)
+            fatal();
+    }
+
     if (global.params.addMain)
     {
         // a dummy name, we never actually look up this file
@@ -1162,8 +1259,18 @@ int main(int argc, char **argv)
         modules.push(m);
     }
 
-    // Read files, parse them
+    // Read the files on a background thread, so that the I/O overlaps with
+    // parsing the files that have already been read.
+    AsyncRead *aw = AsyncRead::create(std::max<size_t>(modules.dim, 1));
     for (unsigned i = 0; i < modules.dim; i++)
+    {
+        if (strcmp(modules[i]->srcfile->name->str, global.main_d) != 0)
+            aw->addFile(modules[i]->srcfile);
+    }
+    aw->start();
+
+    // Parse files
+    for (unsigned i = 0, filei = 0; i < modules.dim; i++)
     {
         Module *m = modules[i];
         if (global.params.verbose)
@@ -1178,14 +1285,20 @@ int main(int argc, char **argv)
             m->srcfile->setbuffer(const_cast<char *>(buf), sizeof(buf));
             m->srcfile->ref = 1;
         }
-        else
+        else if (aw->read(filei++))
         {
+            // Try again to report the error.
             m->read(Loc());
         }
+        if (incremental::isEnabled())
+            incremental::addSource(m);
 
         m->parse(global.params.doDocComments);
         m->buildTargetFiles(singleObj, createSharedLib || createStaticLib);
-        m->deleteObjFile();
+        // Only the output files of modules that are actually recompiled are
+        // deleted in incremental mode.
+        if (!incremental::isEnabled())
+            m->deleteObjFile();
         if (m->isDocFile)
         {
             gendocfile(m);
@@ -1195,9 +1308,13 @@ int main(int argc, char **argv)
             i--;
         }
     }
+    AsyncRead::dispose(aw);
     if (global.errors)
         fatal();
 
+    // Make the modules preloaded by a compile server imports of ours.
+    ldc::adoptPreloadedModules();
+
     if (global.params.doHdrGeneration)
     {
         /* Generate 'header' import files.
@@ -1215,6 +1332,9 @@ int main(int argc, char **argv)
     if (global.errors)
         fatal();
 
+    if (incremental::isEnabled())
+        incremental::removeUpToDateModules(modules);
+
     // load all unconditional imports for better symbol resolving
     for (unsigned i = 0; i < modules.dim; i++)
     {
@@ -1276,7 +1396,8 @@ int main(int argc, char **argv)
     // Generate one or more object/IR/bitcode files.
     if (global.params.obj && !modules.empty())
     {
-        ldc::CodeGenerator cg(llvm::getGlobalContext(), singleObj);
+        ldc::CodeGenerator cg(llvm::getGlobalContext(), singleObj,
+                              backendThreads);
 
         for (unsigned i = 0; i < modules.dim; i++)
         {
@@ -1291,6 +1412,44 @@ int main(int argc, char **argv)
         }
     }
 
+    if (global.params.verbose)
+        fprintf(global.stdmsg, "lookup    %u of %u source file probes answered from directory cache\n",
+                Module::numFileProbesAvoided, Module::numFileProbes);
+
+    if (global.params.verbose && objcache::isEnabled())
+        objcache::printStatistics();
+
+    if (global.params.verbose && TokenCache::isEnabled())
+        TokenCache::printStatistics();
+
+    if (global.params.verbose)
+    {
+        DsymbolTable::printStatistics();
+        ScopeDsymbol::printSearchCacheStatistics();
+        TemplateDeclaration::printConstraintCacheStatistics();
+        fprintf(global.stdmsg, "template  %u speculative instances not analyzed\n",
+                Module::numSpeculativeSkipped);
+        fprintf(global.stdmsg, "deferred  %u passes, %u semantic runs, %u runs skipped waiting for dependencies\n",
+                Module::numDeferredPasses, Module::numDeferredRuns, Module::numDeferredSkipped);
+        printCtfePerformanceStats();
+    }
+
+    if (vtemplates)
+        TemplateDeclaration::printTemplateStats();
+    if (!vtemplatesJson.empty())
+        emitStatsJson(vtemplatesJson.c_str(), &TemplateDeclaration::writeTemplateStatsJson);
+    if (vctfeProfile)
+        printCtfeProfile();
+    if (!vctfeProfileJson.empty())
+        emitStatsJson(vctfeProfileJson.c_str(), &writeCtfeProfileJson);
+
+    if (incremental::isEnabled())
+    {
+        incremental::saveState(modules);
+        if (global.params.verbose)
+            incremental::printStatistics();
+    }
+
     // Generate DDoc output files.
     if (global.params.doDocComments)
     {
@@ -0,0 +1,215 @@
+//===-- objcache.cpp ------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/objcache.h"
+
+#include "mars.h"
+#include "root.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#if LDC_LLVM_VER >= 303
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/Module.h"
+#endif
+#include <cstdio>
+#include <cstring>
+
+namespace {
+std::string g_cacheDir;
+std::string g_commandLine;
+
+llvm::sys::Mutex g_statsMutex;
+unsigned g_hits = 0;
+unsigned g_misses = 0;
+double g_secondsSaved = 0;
+
+/// Returns whether the given command line argument only names an input or
+/// output file (or controls other outputs than the object file), and thus
+/// does not need to be part of the cache key.
+bool isIrrelevantSwitch(const char *arg) {
+    static const char *const switches[] = {
+        "-v", "-vv", "-v-cg", "-op", "-D", "-H", "-X", 0
+    };
+    static const char *const prefixes[] = {
+        "-of", "-od", "-cache=", "-deps", "-Dd", "-Df", "-Hd", "-Hf", "-Xf", 0
+    };
+
+    if (*arg != '-') {
+        // Source, object and library files.
+        const char *ext = FileName::ext(arg);
+        return ext && *ext;
+    }
+    for (const char *const *p = switches; *p; ++p) {
+        if (strcmp(arg, *p) == 0)
+            return true;
+    }
+    for (const char *const *p = prefixes; *p; ++p) {
+        if (strncmp(arg, *p, strlen(*p)) == 0)
+            return true;
+    }
+    return false;
+}
+
+void addString(llvm::MD5 &hash, llvm::StringRef str) {
+    hash.update(str);
+    // Terminate each part so that adjacent ones cannot be confused.
+    hash.update(llvm::StringRef("", 1));
+}
+
+std::string cachePath(const std::string &key, const char *ext) {
+    llvm::SmallString<128> path(g_cacheDir);
+    llvm::sys::path::append(path, key + '.' + ext);
+    return path.str();
+}
+
+/// Copies the file at from to to, replacing any existing file. Returns false
+/// (and removes the partial copy) on failure.
+bool copyFile(const std::string &from, const std::string &to) {
+    FILE *in = fopen(from.c_str(), "rb");
+    if (!in)
+        return false;
+    FILE *out = fopen(to.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+
+    bool ok = true;
+    char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            ok = false;
+            break;
+        }
+    }
+    if (ferror(in))
+        ok = false;
+    fclose(in);
+    if (fclose(out) != 0)
+        ok = false;
+
+    if (!ok)
+        remove(to.c_str());
+    return ok;
+}
+}
+
+namespace objcache {
+
+void init(const char *dir, const std::vector<const char *> &args) {
+    if (FileName::ensurePathExists(dir)) {
+        error(Loc(), "cannot create cache directory '%s'", dir);
+        return;
+    }
+    g_cacheDir = dir;
+
+    // Skip the executable name.
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (!isIrrelevantSwitch(args[i])) {
+            g_commandLine += args[i];
+            g_commandLine += '\0';
+        }
+    }
+}
+
+bool isEnabled() {
+    return !g_cacheDir.empty();
+}
+
+std::string computeKey(llvm::Module &m, llvm::TargetMachine &target) {
+    std::string bitcode;
+    {
+        llvm::raw_string_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(&m, os);
+    }
+
+    llvm::MD5 hash;
+    addString(hash, global.ldc_version);
+    addString(hash, global.llvm_version);
+    addString(hash, target.getTargetTriple().str());
+    addString(hash, target.getTargetCPU());
+    addString(hash, target.getTargetFeatureString());
+    char buf[64];
+    sprintf(buf, "%d %d %d", static_cast<int>(target.getRelocationModel()),
+            static_cast<int>(target.getCodeModel()),
+            static_cast<int>(target.getOptLevel()));
+    addString(hash, buf);
+    addString(hash, g_commandLine);
+    hash.update(bitcode);
+
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    return key.str();
+}
+
+bool lookup(const std::string &key, const std::string &filename) {
+    bool const hit = copyFile(cachePath(key, global.obj_ext), filename);
+
+    double seconds = 0;
+    if (hit) {
+        if (FILE *f = fopen(cachePath(key, "time").c_str(), "r")) {
+            if (fscanf(f, "%lf", &seconds) != 1)
+                seconds = 0;
+            fclose(f);
+        }
+    }
+
+    llvm::MutexGuard lock(g_statsMutex);
+    if (hit) {
+        ++g_hits;
+        g_secondsSaved += seconds;
+    } else {
+        ++g_misses;
+    }
+    return hit;
+}
+
+void store(const std::string &key, const std::string &filename,
+           double seconds) {
+#if LDC_LLVM_VER >= 304
+    std::string const path = cachePath(key, global.obj_ext);
+
+    // Other compiler processes might be accessing the same entry, so copy to a
+    // temporary file first and then atomically move it into place.
+    llvm::SmallString<128> tmpPath;
+    if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%%.tmp", tmpPath))
+        return;
+    if (!copyFile(filename, tmpPath.str())) {
+        remove(tmpPath.c_str());
+        return;
+    }
+
+    if (FILE *f = fopen(cachePath(key, "time").c_str(), "w")) {
+        fprintf(f, "%f\n", seconds);
+        fclose(f);
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) != 0)
+        remove(tmpPath.c_str());
+#endif
+}
+
+void printStatistics() {
+    llvm::MutexGuard lock(g_statsMutex);
+    fprintf(global.stdmsg, "objcache  %u hits, %u misses, %.2fs saved\n",
+            g_hits, g_misses, g_secondsSaved);
+}
+}
@@ -0,0 +1,60 @@
+//===-- driver/objcache.h - Object file cache -------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A content-addressed cache for the object files produced by writeModule(),
+// enabled by -cache=<dir>.
+//
+// The key is a hash of the unoptimized module bitcode, the compiler version,
+// the target machine configuration and the command line switches (except for
+// input/output file names). On a hit, the cached object file is copied to the
+// output location, skipping the LLVM optimization and machine code generation.
+//
+// All functions are safe to call from backend worker threads.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_OBJCACHE_H
+#define LDC_DRIVER_OBJCACHE_H
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+class TargetMachine;
+}
+
+namespace objcache {
+
+/// Enables the cache using the given directory, which is created if it does
+/// not exist yet. args are the command line switches the compiler was invoked
+/// with, which become part of every key.
+void init(const char *dir, const std::vector<const char *> &args);
+
+/// Returns whether the cache is enabled.
+bool isEnabled();
+
+/// Computes the key for caching the object file generated for m.
+std::string computeKey(llvm::Module &m, llvm::TargetMachine &target);
+
+/// Tries to produce the object file for key at filename from the cache and
+/// returns whether this succeeded.
+bool lookup(const std::string &key, const std::string &filename);
+
+/// Adds the object file just written to filename to the cache. seconds is
+/// the time it took to generate it, which is what a later hit saves.
+void store(const std::string &key, const std::string &filename,
+           double seconds);
+
+/// Prints the number of cache hits and misses and the time saved to
+/// global.stdmsg.
+void printStatistics();
+}
+
+#endif
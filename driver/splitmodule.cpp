@@ -0,0 +1,209 @@
+//===-- splitmodule.cpp ---------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/splitmodule.h"
+
+#if LDC_LLVM_VER >= 305
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+typedef DenseMap<const Function *, unsigned> FunctionPartitions;
+
+/// Returns the number of instructions in f, as a rough estimate of the time
+/// spent in machine code generation for it.
+size_t functionSize(const Function &f) {
+    size_t size = 0;
+    for (Function::const_iterator I = f.begin(), E = f.end(); I != E; ++I)
+        size += I->size();
+    return size;
+}
+
+/// Returns whether v is used by code or data emitted in any partition other
+/// than the given one. Uses through constant expressions and aggregate
+/// constants are followed.
+bool isUsedOutside(const Value *v, unsigned partition,
+                   const FunctionPartitions &partitionOf,
+                   std::set<const Value *> &visited) {
+    for (Value::const_user_iterator I = v->user_begin(), E = v->user_end();
+         I != E; ++I) {
+        const User *u = *I;
+        if (const Instruction *inst = dyn_cast<Instruction>(u)) {
+            FunctionPartitions::const_iterator it =
+                partitionOf.find(inst->getParent()->getParent());
+            assert(it != partitionOf.end());
+            if (it->second != partition)
+                return true;
+        } else if (isa<GlobalVariable>(u)) {
+            // Global variable definitions are emitted in partition 0.
+            if (partition != 0)
+                return true;
+        } else if (isa<Constant>(u)) {
+            if (visited.insert(u).second &&
+                isUsedOutside(u, partition, partitionOf, visited)) {
+                return true;
+            }
+        }
+        // Anything else (i.e. metadata in LLVM 3.5) does not end up in the
+        // object file.
+    }
+    return false;
+}
+
+/// Returns whether gv is a local constant not referring to any other symbols
+/// (e.g. a string literal), which is simply copied to every partition that
+/// uses it instead of being shared.
+bool isDuplicable(const GlobalVariable &gv) {
+    if (!gv.hasLocalLinkage() || !gv.isConstant() || !gv.hasInitializer())
+        return false;
+    const Constant *init = gv.getInitializer();
+    return isa<ConstantDataSequential>(init) || isa<ConstantInt>(init) ||
+           isa<ConstantFP>(init) || isa<ConstantAggregateZero>(init);
+}
+
+/// Gives gv a name which is unique across object files and makes it visible
+/// to the other partitions, but not outside the linked binary.
+void externalize(GlobalValue &gv, StringRef uniqueSuffix) {
+    if (gv.hasName())
+        gv.setName(gv.getName() + uniqueSuffix);
+    else
+        gv.setName(Twine("ldc.partition.anon") + uniqueSuffix);
+    gv.setLinkage(GlobalValue::ExternalLinkage);
+    gv.setVisibility(GlobalValue::HiddenVisibility);
+}
+
+bool bySizeDescending(const std::pair<size_t, Function *> &a,
+                      const std::pair<size_t, Function *> &b) {
+    return a.first > b.first;
+}
+}
+
+namespace ldc {
+
+bool canPartitionModule(const Module &m) {
+    return m.alias_empty() && m.getComdatSymbolTable().empty();
+}
+
+void planModulePartitions(Module &m, unsigned numPartitions,
+                          StringRef uniqueSuffix, ModulePartitionPlan &plan) {
+    assert(numPartitions > 0);
+    assert(canPartitionModule(m));
+
+    // Distribute the function definitions, largest first, to the partition
+    // with the least amount of code so far. The sort is stable, so that the
+    // result only depends on the module contents.
+    std::vector<std::pair<size_t, Function *> > defs;
+    for (Module::iterator I = m.begin(), E = m.end(); I != E; ++I) {
+        if (!I->isDeclaration())
+            defs.push_back(std::make_pair(functionSize(*I), &*I));
+    }
+    std::stable_sort(defs.begin(), defs.end(), bySizeDescending);
+
+    FunctionPartitions partitionOf;
+    std::vector<size_t> load(numPartitions, 0);
+    for (size_t i = 0; i < defs.size(); ++i) {
+        unsigned const p = static_cast<unsigned>(
+            std::min_element(load.begin(), load.end()) - load.begin());
+        load[p] += defs[i].first + 1;
+        partitionOf[defs[i].second] = p;
+    }
+
+    // Local symbols referenced from another partition need to be made
+    // visible to the linker.
+    for (Module::global_iterator I = m.global_begin(), E = m.global_end();
+         I != E; ++I) {
+        std::set<const Value *> visited;
+        if (!I->isDeclaration() && I->hasLocalLinkage() && !isDuplicable(*I) &&
+            isUsedOutside(&*I, 0, partitionOf, visited)) {
+            externalize(*I, uniqueSuffix);
+        }
+    }
+    for (size_t i = 0; i < defs.size(); ++i) {
+        Function &f = *defs[i].second;
+        std::set<const Value *> visited;
+        if (f.hasLocalLinkage() &&
+            isUsedOutside(&f, partitionOf[&f], partitionOf, visited)) {
+            externalize(f, uniqueSuffix);
+        } else if (!f.hasName()) {
+            // Needed to refer to it in the plan.
+            f.setName("ldc.partition.fn");
+        }
+    }
+
+    for (size_t i = 0; i < defs.size(); ++i)
+        plan[defs[i].second->getName()] = partitionOf[defs[i].second];
+}
+
+void extractModulePartition(Module &m, unsigned partition,
+                            const ModulePartitionPlan &plan) {
+    // Local symbols which are defined in other partitions are not referenced
+    // from this one (otherwise they would have been externalized) and can be
+    // removed entirely, everything else is turned into a declaration.
+    std::vector<GlobalValue *> dead;
+    // Copies of local constants, which only need to be kept if still used.
+    std::vector<GlobalVariable *> unused;
+
+    for (Module::iterator I = m.begin(), E = m.end(); I != E; ++I) {
+        if (I->isDeclaration())
+            continue;
+        ModulePartitionPlan::const_iterator it = plan.find(I->getName());
+        assert(it != plan.end() && "function not in partition plan");
+        if (it->getValue() == partition)
+            continue;
+        if (I->hasLocalLinkage())
+            dead.push_back(&*I);
+        I->deleteBody();
+    }
+
+    if (partition != 0) {
+        m.setModuleInlineAsm("");
+
+        for (Module::global_iterator I = m.global_begin(), E = m.global_end();
+             I != E; ++I) {
+            if (I->isDeclaration())
+                continue;
+            if (isDuplicable(*I)) {
+                unused.push_back(&*I);
+                continue;
+            }
+            // Appending globals (llvm.used, llvm.global_ctors, ...) cannot be
+            // declared, but are emitted with partition 0 anyway.
+            if (I->hasLocalLinkage() || I->hasAppendingLinkage())
+                dead.push_back(&*I);
+            I->setInitializer(0);
+            I->setLinkage(GlobalValue::ExternalLinkage);
+        }
+    }
+
+    for (size_t i = 0; i < dead.size(); ++i) {
+        GlobalValue *gv = dead[i];
+        gv->removeDeadConstantUsers();
+        if (!gv->use_empty())
+            gv->replaceAllUsesWith(UndefValue::get(gv->getType()));
+        gv->eraseFromParent();
+    }
+
+    for (size_t i = 0; i < unused.size(); ++i) {
+        unused[i]->removeDeadConstantUsers();
+        if (unused[i]->use_empty())
+            unused[i]->eraseFromParent();
+    }
+}
+}
+#endif
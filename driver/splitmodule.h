@@ -0,0 +1,63 @@
+//===-- driver/splitmodule.h - Partitioning of LLVM modules -----*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Splits an (already optimized) LLVM module into several partitions by
+// function, so that machine code generation for a large -singleobj module can
+// run in parallel. Each partition is emitted into an object file of its own.
+//
+// Splitting is done in two steps: planModulePartitions() decides which
+// partition every function is emitted in and makes symbols that are referenced
+// across partitions visible to the linker. The module is then copied once per
+// partition (e.g. by a bitcode round-trip into a different LLVMContext), and
+// extractModulePartition() strips everything from the copy that belongs to
+// other partitions.
+//
+// Only available with LLVM 3.5 and later.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_SPLITMODULE_H
+#define LDC_DRIVER_SPLITMODULE_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm { class Module; }
+
+namespace ldc {
+
+/// Maps the names of all function definitions to their partition index.
+/// Global variable definitions and module-level inline assembly always go to
+/// partition 0.
+typedef llvm::StringMap<unsigned> ModulePartitionPlan;
+
+/// Returns whether m can be split by planModulePartitions(), i.e. does not
+/// contain any constructs the simple partitioning scheme cannot handle yet
+/// (aliases, COMDAT groups).
+bool canPartitionModule(const llvm::Module &m);
+
+/// Assigns the function definitions in m to numPartitions partitions of
+/// roughly equal size and stores the result in plan.
+///
+/// Symbols with local linkage that are used from a partition other than the
+/// one they are defined in are given hidden visibility and external linkage,
+/// and are renamed by appending uniqueSuffix. The suffix should be derived
+/// from the output file name so that the names do not clash with those of
+/// other object files.
+void planModulePartitions(llvm::Module &m, unsigned numPartitions,
+                          llvm::StringRef uniqueSuffix,
+                          ModulePartitionPlan &plan);
+
+/// Turns m, a copy of a module prepared by planModulePartitions(), into the
+/// given partition by removing all definitions belonging to other partitions.
+void extractModulePartition(llvm::Module &m, unsigned partition,
+                            const ModulePartitionPlan &plan);
+}
+
+#endif
@@ -565,3 +565,16 @@ llvm::TargetMachine* createTargetMachine(
         codeGenOptLevel
     );
 }
+
+llvm::TargetMachine* cloneTargetMachine(const llvm::TargetMachine &tm)
+{
+    return tm.getTarget().createTargetMachine(
+        tm.getTargetTriple().str(),
+        tm.getTargetCPU(),
+        tm.getTargetFeatureString(),
+        tm.Options,
+        tm.getRelocationModel(),
+        tm.getCodeModel(),
+        tm.getOptLevel()
+    );
+}
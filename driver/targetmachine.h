@@ -68,6 +68,15 @@ llvm::TargetMachine* createTargetMachine(
     bool noLinkerStripDead
     );
 
+/**
+ * Creates a new TargetMachine with the same target, CPU, features and options
+ * as the given one.
+ *
+ * TargetMachine instances must not be shared between threads, so every
+ * backend worker thread uses its own copy of the global one.
+ */
+llvm::TargetMachine* cloneTargetMachine(const llvm::TargetMachine &tm);
+
 /**
  * Returns the Mips ABI which is used for code generation.
  *
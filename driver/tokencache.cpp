@@ -0,0 +1,446 @@
+//===-- tokencache.cpp ----------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/tokencache.h"
+
+#include "identifier.h"
+#include "mars.h"
+#include "rmem.h"
+#include "root.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace {
+std::string g_cacheDir;
+unsigned g_hits = 0;
+unsigned g_misses = 0;
+
+const char fileMagic[8] = { 'L', 'D', 'C', 'T', 'O', 'K', '1', '\0' };
+const uint32_t none = 0xFFFFFFFF;
+
+/// The layout of a cache file: the header, followed by the string offsets of
+/// the identifier names, the token records and the NUL-terminated strings.
+/// It is only ever read by the same compiler version, so the native layout
+/// and byte order are used.
+struct Header {
+    char magic[8];
+    uint32_t numRecords;
+    uint32_t numIdents;
+    uint32_t stringsSize;
+    uint32_t numLines;
+};
+
+enum Payload {
+    PayloadNone,
+    PayloadInteger,
+    PayloadFloat,
+    PayloadString,
+    PayloadIdent
+};
+
+Payload payloadOf(const Token *t) {
+    switch (t->value) {
+    case TOKint32v: case TOKuns32v:
+    case TOKint64v: case TOKuns64v:
+    case TOKcharv: case TOKwcharv: case TOKdcharv:
+        return PayloadInteger;
+
+    case TOKfloat32v: case TOKfloat64v: case TOKfloat80v:
+    case TOKimaginary32v: case TOKimaginary64v: case TOKimaginary80v:
+        return PayloadFloat;
+
+    case TOKstring:
+    case TOKxstring:
+        return PayloadString;
+
+    case TOKeof:
+        return PayloadNone;
+
+    default:
+        // Identifiers and keywords.
+        if (t->ptr && (isalpha(*t->ptr) || *t->ptr == '_' || *t->ptr >= 0x80))
+            return PayloadIdent;
+        return PayloadNone;
+    }
+}
+
+std::string md5(const llvm::StringRef *parts, size_t numParts) {
+    llvm::MD5 hash;
+    for (size_t i = 0; i < numParts; ++i) {
+        hash.update(parts[i]);
+        hash.update(llvm::StringRef("", 1));
+    }
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> str;
+    llvm::MD5::stringifyResult(result, str);
+    return std::string(str.begin(), str.end());
+}
+
+std::string cachePath(const std::string &name) {
+    llvm::SmallString<128> path(g_cacheDir);
+    llvm::sys::path::append(path, name);
+    return std::string(path.begin(), path.end());
+}
+
+/// Returns the key of the cache entry for the given source file, a hash of its
+/// contents, the compiler version and whether doc comments are collected.
+///
+/// To avoid hashing the contents every time, the key is also stored in an
+/// index entry named after the hash of the file's path, size and modification
+/// time. This is only done once the file has not been modified for a few
+/// seconds, so that a later modification always changes the time stamp.
+std::string entryKey(const char *filename, const utf8_t *buf, size_t buflen,
+                     bool docComments) {
+    llvm::StringRef const doc = docComments ? "doc" : "";
+    std::string indexPath;
+    struct stat st;
+    bool const indexable = stat(filename, &st) == 0 &&
+                           static_cast<size_t>(st.st_size) == buflen &&
+                           st.st_mtime + 2 < time(NULL);
+    if (indexable) {
+        char stamp[64];
+        sprintf(stamp, "%llu %lld", static_cast<unsigned long long>(st.st_size),
+                static_cast<long long>(st.st_mtime));
+        llvm::SmallString<128> path(filename);
+        llvm::sys::fs::make_absolute(path);
+        llvm::StringRef const parts[] = { global.ldc_version,
+                                          global.llvm_version, doc, path.str(),
+                                          stamp };
+        indexPath = cachePath(md5(parts, 5) + ".idx");
+
+        char key[33];
+        FILE *f = fopen(indexPath.c_str(), "rb");
+        if (f) {
+            size_t const n = fread(key, 1, 32, f);
+            fclose(f);
+            if (n == 32) {
+                key[32] = '\0';
+                return key;
+            }
+        }
+    }
+
+    llvm::StringRef const parts[] = {
+        global.ldc_version, global.llvm_version, doc,
+        llvm::StringRef(reinterpret_cast<const char *>(buf), buflen)
+    };
+    std::string const key = md5(parts, 4);
+
+    if (indexable) {
+        // Entries are written by other compiler processes as well, but all of
+        // them have the same contents.
+        FILE *f = fopen(indexPath.c_str(), "wb");
+        if (f) {
+            bool const ok = fwrite(key.data(), 1, key.size(), f) == key.size();
+            if (fclose(f) != 0 || !ok)
+                remove(indexPath.c_str());
+        }
+    }
+    return key;
+}
+
+/// Returns a copy of the given string from the cache file, which is unmapped
+/// once the module has been parsed.
+char *copyString(const char *str, size_t len) {
+    char *copy = static_cast<char *>(mem.malloc(len + 1));
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+}
+
+void TokenCache::init(const char *dir) {
+    if (FileName::ensurePathExists(dir)) {
+        error(Loc(), "cannot create token cache directory '%s'", dir);
+        return;
+    }
+    g_cacheDir = dir;
+}
+
+bool TokenCache::isEnabled() {
+    return !g_cacheDir.empty();
+}
+
+TokenCache *TokenCache::create(Lexer *lexer, const utf8_t *buf, size_t buflen,
+                               bool docComments) {
+    if (!isEnabled() || buflen >= none)
+        return NULL;
+
+    const char *filename = lexer->scanloc.filename;
+    TokenCache *cache = new TokenCache(
+        cachePath(entryKey(filename, buf, buflen, docComments) + ".tok"),
+        filename);
+    if (cache->load(buflen))
+        ++g_hits;
+    else
+        ++g_misses;
+    return cache;
+}
+
+void TokenCache::printStatistics() {
+    fprintf(global.stdmsg, "tokcache  %u hits, %u misses\n", g_hits, g_misses);
+}
+
+TokenCache::TokenCache(const std::string &path, const char *filename)
+    : path(path), filename(filename), file(NULL), records(NULL), numRecords(0),
+      pos(0), strings(NULL), numLines(0), cacheable(true) {}
+
+TokenCache::~TokenCache() {
+    delete file;
+}
+
+bool TokenCache::load(size_t buflen) {
+    File *f = new File(path.c_str());
+#if LDC_POSIX
+    int const failed = f->mmread();
+#else
+    int const failed = f->read();
+#endif
+    if (failed) {
+        delete f;
+        return false;
+    }
+
+    const char *data = reinterpret_cast<const char *>(f->buffer);
+    size_t const size = f->len;
+    Header header;
+    if (size < sizeof(header)) {
+        delete f;
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    size_t const identsOffset = sizeof(header);
+    size_t const recordsOffset =
+        identsOffset + header.numIdents * sizeof(uint32_t);
+    size_t const stringsOffset =
+        recordsOffset + header.numRecords * sizeof(Record);
+    bool valid = memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0 &&
+                 header.numRecords > 0 && header.numIdents < size &&
+                 header.numRecords < size && header.stringsSize > 0 &&
+                 stringsOffset + header.stringsSize == size &&
+                 data[size - 1] == '\0';
+
+    // Check all offsets upfront, so that a corrupt file cannot make the
+    // parser read out of bounds.
+    const uint32_t *identOffsets =
+        reinterpret_cast<const uint32_t *>(data + identsOffset);
+    for (size_t i = 0; valid && i < header.numIdents; ++i)
+        valid = identOffsets[i] < header.stringsSize;
+    const Record *recs = reinterpret_cast<const Record *>(data + recordsOffset);
+    for (size_t i = 0; valid && i < header.numRecords; ++i) {
+        const Record &r = recs[i];
+        uint32_t index;
+        memcpy(&index, r.data, sizeof(index));
+        valid = r.value < TOKMAX && r.ptr <= buflen &&
+                (r.filename == none || r.filename < header.stringsSize) &&
+                (r.blockComment == none ||
+                 r.blockComment < header.stringsSize) &&
+                (r.lineComment == none || r.lineComment < header.stringsSize);
+        if (valid && r.payload == PayloadString)
+            valid = index < header.stringsSize &&
+                    r.len < header.stringsSize - index;
+        else if (valid && r.payload == PayloadIdent)
+            valid = index < header.numIdents;
+    }
+    if (!valid || recs[header.numRecords - 1].value != TOKeof) {
+        delete f;
+        return false;
+    }
+
+    file = f;
+    records = recs;
+    numRecords = header.numRecords;
+    strings = data + stringsOffset;
+    numLines = header.numLines;
+    idents.reserve(header.numIdents);
+    for (size_t i = 0; i < header.numIdents; ++i)
+        idents.push_back(Lexer::idPool(strings + identOffsets[i]));
+    return true;
+}
+
+void TokenCache::scan(Lexer *lexer, Token *t) {
+    if (records)
+        replay(lexer, t);
+    else
+        record(lexer, t);
+}
+
+void TokenCache::replay(Lexer *lexer, Token *t) {
+    // The parser never goes past the end of file token, but keep returning
+    // it just like the lexer would.
+    const Record &r = records[pos < numRecords ? pos++ : numRecords - 1];
+
+    t->value = static_cast<TOK>(r.value);
+    t->ptr = lexer->base + r.ptr;
+    t->loc = Loc();
+    t->loc.filename = r.filename == none ? filename : lineFilename(r.filename);
+    t->loc.linnum = r.linnum;
+    t->loc.charnum = r.charnum;
+    // Comments and strings end up in the AST, so they are copied just like
+    // the lexer does.
+    t->blockComment = r.blockComment == none ? NULL :
+        reinterpret_cast<const utf8_t *>(mem.strdup(strings + r.blockComment));
+    t->lineComment = r.lineComment == none ? NULL :
+        reinterpret_cast<const utf8_t *>(mem.strdup(strings + r.lineComment));
+
+    uint32_t index;
+    switch (r.payload) {
+    case PayloadInteger:
+        memcpy(&t->uns64value, r.data, sizeof(t->uns64value));
+        break;
+    case PayloadFloat:
+        memcpy(&t->float80value, r.data, sizeof(t->float80value));
+        break;
+    case PayloadString:
+        memcpy(&index, r.data, sizeof(index));
+        t->ustring = reinterpret_cast<utf8_t *>(copyString(strings + index, r.len));
+        t->len = r.len;
+        t->postfix = static_cast<unsigned char>(r.postfix);
+        break;
+    case PayloadIdent:
+        memcpy(&index, r.data, sizeof(index));
+        t->ident = idents[index];
+        break;
+    default:
+        break;
+    }
+
+    if (t->value == TOKeof)
+        lexer->scanloc.linnum = numLines;
+}
+
+const char *TokenCache::lineFilename(uint32_t offset) {
+    std::map<uint32_t, const char *>::iterator it = lineFilenames.find(offset);
+    if (it != lineFilenames.end())
+        return it->second;
+    const char *copy = mem.strdup(strings + offset);
+    lineFilenames[offset] = copy;
+    return copy;
+}
+
+unsigned TokenCache::addString(const utf8_t *str, size_t len) {
+    unsigned const offset = static_cast<unsigned>(stringData.size());
+    stringData.insert(stringData.end(), str, str + len);
+    stringData.push_back('\0');
+    return offset;
+}
+
+void TokenCache::record(Lexer *lexer, Token *t) {
+    unsigned const diagnostics = lexer->numDiagnostics;
+    lexer->scan(t);
+    // The diagnostics of the lexer would not be reported when replaying.
+    if (lexer->numDiagnostics != diagnostics)
+        cacheable = false;
+    if (!cacheable)
+        return;
+
+    Record r;
+    memset(&r, 0, sizeof(r));
+    r.value = t->value;
+    r.payload = payloadOf(t);
+    r.ptr = static_cast<uint32_t>(t->ptr - lexer->base);
+    r.linnum = t->loc.linnum;
+    r.charnum = t->loc.charnum;
+    r.filename = t->loc.filename == filename ? none :
+        addString(reinterpret_cast<const utf8_t *>(t->loc.filename),
+                  strlen(t->loc.filename));
+    r.blockComment = t->blockComment ?
+        addString(t->blockComment, strlen((const char *)t->blockComment)) : none;
+    r.lineComment = t->lineComment ?
+        addString(t->lineComment, strlen((const char *)t->lineComment)) : none;
+
+    uint32_t index;
+    switch (r.payload) {
+    case PayloadInteger:
+        memcpy(r.data, &t->uns64value, sizeof(t->uns64value));
+        break;
+    case PayloadFloat:
+        memcpy(r.data, &t->float80value, sizeof(t->float80value));
+        break;
+    case PayloadString:
+        // __DATE__, __TIME__, __TIMESTAMP__ (and __VENDOR__).
+        if (t->ptr[0] == '_')
+            cacheable = false;
+        index = addString(t->ustring, t->len);
+        memcpy(r.data, &index, sizeof(index));
+        r.len = t->len;
+        r.postfix = t->postfix;
+        break;
+    case PayloadIdent: {
+        std::map<Identifier *, unsigned>::iterator it = identIndices.find(t->ident);
+        if (it == identIndices.end()) {
+            index = static_cast<uint32_t>(identOffsets.size());
+            identIndices[t->ident] = index;
+            const char *name = t->ident->toChars();
+            identOffsets.push_back(addString(
+                reinterpret_cast<const utf8_t *>(name), strlen(name)));
+        } else {
+            index = it->second;
+        }
+        memcpy(r.data, &index, sizeof(index));
+        break;
+    }
+    default:
+        break;
+    }
+    recorded.push_back(r);
+}
+
+void TokenCache::finish(Lexer *lexer, bool success) {
+    if (records || !success || !cacheable || recorded.empty() ||
+        recorded.back().value != TOKeof || stringData.size() >= none) {
+        return;
+    }
+    // Make sure the string section is never empty.
+    stringData.push_back('\0');
+
+    Header header;
+    memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.numRecords = static_cast<uint32_t>(recorded.size());
+    header.numIdents = static_cast<uint32_t>(identOffsets.size());
+    header.stringsSize = static_cast<uint32_t>(stringData.size());
+    header.numLines = lexer->scanloc.linnum;
+
+#if LDC_LLVM_VER >= 304
+    // Other compiler processes might be writing the same entry, so write to a
+    // temporary file first and then atomically move it into place.
+    llvm::SmallString<128> tmpPath;
+    if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%%.tmp", tmpPath))
+        return;
+    FILE *f = fopen(tmpPath.c_str(), "wb");
+    if (!f) {
+        remove(tmpPath.c_str());
+        return;
+    }
+
+    fwrite(&header, sizeof(header), 1, f);
+    if (!identOffsets.empty())
+        fwrite(&identOffsets[0], sizeof(uint32_t), identOffsets.size(), f);
+    fwrite(&recorded[0], sizeof(Record), recorded.size(), f);
+    fwrite(&stringData[0], 1, stringData.size(), f);
+    bool ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = false;
+
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+        remove(tmpPath.c_str());
+#endif
+}
@@ -0,0 +1,116 @@
+//===-- driver/tokencache.h - Cache of lexed imports ------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A cache for the token streams of imported modules, enabled by
+// -token-cache=<dir>.
+//
+// The big imports (std.algorithm, std.range, generated code, ...) are lexed
+// anew by every compiler invocation. With the cache enabled, the tokens the
+// lexer produces for an imported module are written to a file in binary form
+// the first time, and on later compilations read (memory mapped where
+// possible) and handed to the parser instead of lexing the source again.
+//
+// Entries are keyed by a hash of the source file contents, the compiler
+// version and whether doc comments are collected, so they never need to be
+// invalidated and can be shared between different checkouts of the same
+// sources. The hash of a file is itself cached by its path, size and
+// modification time, so unchanged files are not hashed again. A module is not
+// cached if lexing it produced any diagnostics, as they would not be reported
+// when replaying the tokens, or if it uses __DATE__, __TIME__ or __TIMESTAMP__.
+//
+// This is a smaller substitute for precompiled module interfaces, not an
+// equivalent: only the lexing is skipped. Parsing and all of semantic
+// analysis of the imported modules still run on every compilation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_TOKENCACHE_H
+#define LDC_DRIVER_TOKENCACHE_H
+
+#include "lexer.h"
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class File;
+
+class TokenCache {
+public:
+    /// Enables the cache using the given directory, which is created if it
+    /// does not exist yet.
+    static void init(const char *dir);
+
+    /// Returns whether the cache is enabled.
+    static bool isEnabled();
+
+    /// Returns the cache for the source buffer about to be scanned by lexer,
+    /// which either replays the tokens from a previous compilation or records
+    /// them, or NULL if the cache is not enabled.
+    static TokenCache *create(Lexer *lexer, const utf8_t *buf, size_t buflen,
+                              bool docComments);
+
+    /// Prints the number of hits and misses to global.stdmsg.
+    static void printStatistics();
+
+    /// Called by the lexer instead of Lexer::scan() to produce the next token.
+    void scan(Lexer *lexer, Token *t);
+
+    /// Writes the recorded tokens to the cache once the module has been
+    /// parsed, unless success is false.
+    void finish(Lexer *lexer, bool success);
+
+    ~TokenCache();
+
+private:
+    /// A token as stored in the cache file.
+    struct Record {
+        uint32_t value;
+        uint32_t payload;
+        uint32_t ptr;      // offset of the token in the source buffer
+        uint32_t linnum;
+        uint32_t charnum;
+        uint32_t filename; // string offset, or none if not changed by #line
+        uint32_t blockComment;
+        uint32_t lineComment;
+        uint32_t len;
+        uint32_t postfix;
+        // The integer or float value, the string offset or identifier index.
+        unsigned char data[sizeof(d_float80)];
+    };
+
+    TokenCache(const std::string &path, const char *filename);
+    bool load(size_t buflen);
+    void record(Lexer *lexer, Token *t);
+    void replay(Lexer *lexer, Token *t);
+    unsigned addString(const utf8_t *str, size_t len);
+    const char *lineFilename(uint32_t offset);
+
+    std::string path;
+    const char *filename; // the file name of the tokens not after #line
+
+    // Replaying
+    File *file;
+    const Record *records;
+    size_t numRecords;
+    size_t pos;
+    std::vector<Identifier *> idents;
+    const char *strings;
+    unsigned numLines;
+    std::map<uint32_t, const char *> lineFilenames; // copies of #line names
+
+    // Recording
+    bool cacheable;
+    std::vector<Record> recorded;
+    std::map<Identifier *, unsigned> identIndices;
+    std::vector<unsigned> identOffsets;
+    std::vector<char> stringData;
+};
+
+#endif
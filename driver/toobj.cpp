@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "driver/toobj.h"
+#include "driver/objcache.h"
 #include "driver/targetmachine.h"
 #include "driver/tool.h"
 #include "gen/irstate.h"
@@ -31,6 +32,7 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/Timer.h"
 #if LDC_LLVM_VER < 304
 #include "llvm/Support/PathV1.h"
 #endif
@@ -130,7 +132,8 @@ static void codegenModule(llvm::TargetMachine &Target, llvm::Module& m,
     Passes.run(m);
 }
 
-static void assemble(const std::string &asmpath, const std::string &objpath)
+static bool assemble(const std::string &asmpath, const std::string &objpath,
+                     std::string &errorMsg)
 {
     std::vector<std::string> args;
     args.push_back("-O3");
@@ -186,33 +189,47 @@ static void assemble(const std::string &asmpath, const std::string &objpath)
     int R = executeToolAndWait(gcc, args, global.params.verbose);
     if (R)
     {
-        error(Loc(), "Error while invoking external assembler.");
-        fatal();
+        errorMsg = "Error while invoking external assembler.";
+        return false;
     }
+    return true;
+}
+
+#if LDC_LLVM_VER >= 306
+static std::string errorString(const std::error_code &errinfo)
+{
+    return errinfo.message();
 }
+#else
+static std::string errorString(const std::string &errinfo)
+{
+    return errinfo;
+}
+#endif
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
 namespace
 {
     using namespace llvm;
-    static void printDebugLoc(const DebugLoc& debugLoc, formatted_raw_ostream& os)
+    static void printDebugLoc(const DebugLoc& debugLoc, LLVMContext& ctx,
+                              formatted_raw_ostream& os)
     {
         os << debugLoc.getLine() << ":" << debugLoc.getCol();
 #if LDC_LLVM_VER >= 307
         if (DILocation *IDL = debugLoc.getInlinedAt())
         {
             os << "@";
-            printDebugLoc(IDL, os);
+            printDebugLoc(IDL, ctx, os);
         }
 #else
-        if (MDNode *N = debugLoc.getInlinedAt(getGlobalContext()))
+        if (MDNode *N = debugLoc.getInlinedAt(ctx))
         {
             DebugLoc IDL = DebugLoc::getFromDILocation(N);
             if (!IDL.isUnknown())
             {
                 os << "@";
-                printDebugLoc(IDL, os);
+                printDebugLoc(IDL, ctx, os);
             }
         }
 #endif
@@ -311,7 +328,7 @@ namespace
                     os << ';';
                 }
                 os << " [debug line = ";
-                printDebugLoc(debugLoc, os);
+                printDebugLoc(debugLoc, instr->getContext(), os);
                 os << ']';
             }
             if (const DbgDeclareInst* DDI = dyn_cast<DbgDeclareInst>(instr))
@@ -388,25 +405,48 @@ namespace
     };
 } // end of anonymous namespace
 
-void writeModule(llvm::Module* m, std::string filename)
+static bool useExternalAssembler()
 {
-    // run optimizer
-    ldc_optimize_module(m);
-
 #if LDC_LLVM_VER >= 305
     // There is no integrated assembler on AIX because XCOFF is not supported.
     // Starting with LLVM 3.5 the integrated assembler can be used with MinGW.
-    bool const assembleExternally = global.params.output_o &&
-        (NoIntegratedAssembler ||
-        global.params.targetTriple.getOS() == llvm::Triple::AIX);
+    return NoIntegratedAssembler ||
+        global.params.targetTriple.getOS() == llvm::Triple::AIX;
 #else
     // (We require LLVM 3.5 with AIX.)
     // We don't use the integrated assembler with MinGW as it does not support
     // emitting DW2 exception handling tables.
-    bool const assembleExternally = global.params.output_o &&
-        (NoIntegratedAssembler ||
-        global.params.targetTriple.getOS() == llvm::Triple::MinGW32);
+    return NoIntegratedAssembler ||
+        global.params.targetTriple.getOS() == llvm::Triple::MinGW32;
 #endif
+}
+
+bool writesObjectFileOnly()
+{
+    return global.params.output_o && !global.params.output_bc &&
+        !global.params.output_ll && !global.params.output_s &&
+        !useExternalAssembler();
+}
+
+void writeModule(llvm::Module* m, std::string filename)
+{
+    std::string errorMsg;
+    if (!writeModule(m, filename, *gTargetMachine, errorMsg))
+    {
+        error(Loc(), "%s", errorMsg.c_str());
+        fatal();
+    }
+}
+
+static bool optimizeAndWriteModule(llvm::Module* m, std::string filename,
+                                   llvm::TargetMachine &target,
+                                   std::string &errorMsg)
+{
+    // run optimizer
+    ldc_optimize_module(m, target);
+
+    bool const assembleExternally = global.params.output_o &&
+        useExternalAssembler();
 
     // eventually do our own path stuff, dmd's is a bit strange.
     typedef llvm::SmallString<128> LLPath;
@@ -430,14 +470,9 @@ void writeModule(llvm::Module* m, std::string filename)
                 );
         if (bos.has_error())
         {
-            error(Loc(), "cannot write LLVM bitcode file '%s': %s", bcpath.c_str(),
-#if LDC_LLVM_VER >= 306
-            errinfo
-#else
-            errinfo.c_str()
-#endif
-            );
-            fatal();
+            errorMsg = std::string("cannot write LLVM bitcode file '") +
+                bcpath.c_str() + "': " + errorString(errinfo);
+            return false;
         }
         llvm::WriteBitcodeToFile(m, bos);
     }
@@ -461,14 +496,9 @@ void writeModule(llvm::Module* m, std::string filename)
             );
         if (aos.has_error())
         {
-            error(Loc(), "cannot write LLVM asm file '%s': %s", llpath.c_str(),
-#if LDC_LLVM_VER >= 306
-            errinfo
-#else
-            errinfo.c_str()
-#endif
-            );
-            fatal();
+            errorMsg = std::string("cannot write LLVM asm file '") +
+                llpath.c_str() + "': " + errorString(errinfo);
+            return false;
         }
         AssemblyAnnotator annotator;
         m->print(aos, &annotator);
@@ -511,25 +541,20 @@ void writeModule(llvm::Module* m, std::string filename)
             if (errinfo.empty())
 #endif
             {
-                codegenModule(*gTargetMachine, *m, out, llvm::TargetMachine::CGFT_AssemblyFile);
+                codegenModule(target, *m, out, llvm::TargetMachine::CGFT_AssemblyFile);
             }
             else
             {
-                error(Loc(), "cannot write native asm: %s",
-#if LDC_LLVM_VER >= 306
-                errinfo
-#else
-                errinfo.c_str()
-#endif
-                );
-                fatal();
+                errorMsg = "cannot write native asm: " + errorString(errinfo);
+                return false;
             }
         }
 
         if (assembleExternally)
         {
             LLPath objpath(filename);
-            assemble(spath.str(), objpath.str());
+            if (!assemble(spath.str(), objpath.str(), errorMsg))
+                return false;
         }
 
         if (!global.params.output_s)
@@ -543,41 +568,69 @@ void writeModule(llvm::Module* m, std::string filename)
         }
     }
 
-    if (global.params.output_o && !assembleExternally) {
-        LLPath objpath = LLPath(filename);
-        Logger::println("Writing object file to: %s\n", objpath.c_str());
+    if (global.params.output_o && !assembleExternally)
+        return writeObjectFile(m, filename, target, errorMsg);
+
+    return true;
+}
+
+bool writeModule(llvm::Module* m, std::string filename,
+                 llvm::TargetMachine &target, std::string &errorMsg)
+{
+    // Only the object file is cached, so the cache can only be used if
+    // nothing else needs to be generated.
+    if (!objcache::isEnabled() || !writesObjectFileOnly())
+        return optimizeAndWriteModule(m, filename, target, errorMsg);
+
+    std::string const key = objcache::computeKey(*m, target);
+    if (objcache::lookup(key, filename))
+    {
+        Logger::println("Object cache hit for: %s\n", filename.c_str());
+        return true;
+    }
+
+    double const start = llvm::TimeRecord::getCurrentTime(true).getWallTime();
+    if (!optimizeAndWriteModule(m, filename, target, errorMsg))
+        return false;
+    objcache::store(key, filename,
+        llvm::TimeRecord::getCurrentTime(false).getWallTime() - start);
+    return true;
+}
+
+bool writeObjectFile(llvm::Module* m, std::string filename,
+                     llvm::TargetMachine &target, std::string &errorMsg)
+{
+    typedef llvm::SmallString<128> LLPath;
+
+    LLPath objpath = LLPath(filename);
+    Logger::println("Writing object file to: %s\n", objpath.c_str());
 #if LDC_LLVM_VER >= 306
-        std::error_code errinfo;
+    std::error_code errinfo;
 #else
-        std::string errinfo;
+    std::string errinfo;
 #endif
-        {
-            llvm::raw_fd_ostream out(objpath.c_str(), errinfo, 
+    {
+        llvm::raw_fd_ostream out(objpath.c_str(), errinfo, 
 #if LDC_LLVM_VER >= 305
-                llvm::sys::fs::F_None
-#else
-                llvm::sys::fs::F_Binary
-#endif
-                );
-#if LDC_LLVM_VER >= 306
-            if (!errinfo)
+            llvm::sys::fs::F_None
 #else
-            if (errinfo.empty())
+            llvm::sys::fs::F_Binary
 #endif
-            {
-                codegenModule(*gTargetMachine, *m, out, llvm::TargetMachine::CGFT_ObjectFile);
-            }
-            else
-            {
-                error(Loc(), "cannot write object file: %s",
+            );
 #if LDC_LLVM_VER >= 306
-                errinfo
+        if (!errinfo)
 #else
-                errinfo.c_str()
+        if (errinfo.empty())
 #endif
-                );
-                fatal();
-            }
+        {
+            codegenModule(target, *m, out, llvm::TargetMachine::CGFT_ObjectFile);
+        }
+        else
+        {
+            errorMsg = "cannot write object file: " + errorString(errinfo);
+            return false;
         }
     }
+
+    return true;
 }
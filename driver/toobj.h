@@ -16,8 +16,22 @@
 
 #include <string>
 
-namespace llvm { class Module; }
+namespace llvm { class Module; class TargetMachine; }
 
 void writeModule(llvm::Module* m, std::string filename);
 
+// Like writeModule(), but uses the given target machine and returns false with
+// the error message set instead of aborting the compilation, so that it can
+// be called from backend worker threads.
+bool writeModule(llvm::Module* m, std::string filename,
+                 llvm::TargetMachine &target, std::string &errorMsg);
+
+// Returns whether writeModule() only produces a native object file, using the
+// integrated assembler (i.e. no bitcode, IR or assembly output was requested).
+bool writesObjectFileOnly();
+
+// Emits the given, already optimized module as native object file.
+bool writeObjectFile(llvm::Module* m, std::string filename,
+                     llvm::TargetMachine &target, std::string &errorMsg);
+
 #endif
@@ -330,7 +330,7 @@ static void addOptimizationPasses(PassManagerBase &mpm, FunctionPassManager &fpm
 //////////////////////////////////////////////////////////////////////////////////////////
 // This function runs optimization passes based on command line arguments.
 // Returns true if any optimization passes were invoked.
-bool ldc_optimize_module(llvm::Module *M)
+bool ldc_optimize_module(llvm::Module *M, llvm::TargetMachine &target)
 {
     // Create a PassManager to hold and optimize the collection of
     // per-module passes we are about to build.
@@ -379,10 +379,10 @@ bool ldc_optimize_module(llvm::Module *M)
 
 #if LDC_LLVM_VER >= 307
     // Add internal analysis passes from the target machine.
-    mpm.add(createTargetTransformInfoWrapperPass(gTargetMachine->getTargetIRAnalysis()));
+    mpm.add(createTargetTransformInfoWrapperPass(target.getTargetIRAnalysis()));
 #elif LDC_LLVM_VER >= 305
     // Add internal analysis passes from the target machine.
-    gTargetMachine->addAnalysisPasses(mpm);
+    target.addAnalysisPasses(mpm);
 #endif
 
     // Also set up a manager for the per-function passes.
@@ -393,13 +393,13 @@ bool ldc_optimize_module(llvm::Module *M)
 
 #if LDC_LLVM_VER >= 307
     // Add internal analysis passes from the target machine.
-    fpm.add(createTargetTransformInfoWrapperPass(gTargetMachine->getTargetIRAnalysis()));
+    fpm.add(createTargetTransformInfoWrapperPass(target.getTargetIRAnalysis()));
 #elif LDC_LLVM_VER >= 306
     fpm.add(new DataLayoutPass());
-    gTargetMachine->addAnalysisPasses(fpm);
+    target.addAnalysisPasses(fpm);
 #elif LDC_LLVM_VER == 305
     fpm.add(new DataLayoutPass(M));
-    gTargetMachine->addAnalysisPasses(fpm);
+    target.addAnalysisPasses(fpm);
 #elif LDC_LLVM_VER >= 302
     fpm.add(new DataLayout(M));
 #else
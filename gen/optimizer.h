@@ -29,9 +29,12 @@ extern llvm::cl::opt<SanitizerCheck> sanitize;
 }
 #endif
 
-namespace llvm { class Module; }
+namespace llvm { class Module; class TargetMachine; }
 
-bool ldc_optimize_module(llvm::Module* m);
+// Runs the optimization passes for the given module. The target machine is
+// passed explicitly so that modules can be optimized on backend worker
+// threads, each with its own TargetMachine instance.
+bool ldc_optimize_module(llvm::Module* m, llvm::TargetMachine &target);
 
 // Returns whether the normal, full inlining pass will be run.
 bool willInline();
@@ -0,0 +1,265 @@
+//===-- stringtable.cpp - StringTable microbenchmark ----------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Compares the throughput of interning the identifiers of real D sources in
+// the frontend's StringTable (as Lexer::idPool does) with the previous
+// implementation, a fixed number of buckets holding binary trees.
+//
+// Usage: stringtable-bench [-n <repetitions>] <file.d>...
+//
+// Exits with a non-zero status if the two tables disagree on the number of
+// distinct identifiers, so that it can double as a test.
+//
+//===----------------------------------------------------------------------===//
+
+#include "rmem.h"
+#include "stringtable.h"
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Token {
+    const char *ptr;
+    size_t len;
+};
+
+bool isIdentStart(char c) { return isalpha(c) || c == '_'; }
+bool isIdentChar(char c) { return isalnum(c) || c == '_'; }
+
+/// Appends the identifiers and keywords in the given D source to tokens,
+/// skipping comments and string literals (well enough for a benchmark).
+void scanIdentifiers(const std::string &src, std::vector<Token> &tokens) {
+    const char *p = src.c_str();
+    const char *end = p + src.size();
+    while (p < end) {
+        if (p[0] == '/' && p[1] == '/') {
+            while (p < end && *p != '\n')
+                ++p;
+        } else if (p[0] == '/' && (p[1] == '*' || p[1] == '+')) {
+            char const close = p[1];
+            for (p += 2; p < end && !(p[0] == close && p[1] == '/'); ++p) {
+            }
+            p += 2;
+        } else if (*p == '"' || *p == '`') {
+            char const quote = *p++;
+            for (; p < end && *p != quote; ++p) {
+                if (*p == '\\' && quote == '"')
+                    ++p;
+            }
+            ++p;
+        } else if (isIdentStart(*p)) {
+            Token t;
+            t.ptr = p;
+            while (p < end && isIdentChar(*p))
+                ++p;
+            t.len = p - t.ptr;
+            tokens.push_back(t);
+        } else {
+            ++p;
+        }
+    }
+}
+
+/// The previous StringTable: 6151 buckets, each an unbalanced binary tree of
+/// separately allocated nodes, with the old calcHash().
+class TreeStringTable {
+public:
+    TreeStringTable() : table(6151, static_cast<Node *>(0)), count(0) {}
+    ~TreeStringTable() {
+        for (size_t i = 0; i < table.size(); ++i)
+            freeTree(table[i]);
+    }
+
+    const char *update(const char *s, size_t len) {
+        size_t const hash = calcHash(s, len);
+        Node **n = &table[hash % table.size()];
+        while (*n) {
+            int cmp = (*n)->hash == hash ? 0 : (*n)->hash < hash ? -1 : 1;
+            if (cmp == 0) {
+                cmp = static_cast<int>((*n)->len - len);
+                if (cmp == 0) {
+                    cmp = memcmp(s, (*n)->str(), len);
+                    if (cmp == 0)
+                        return (*n)->str();
+                }
+            }
+            n = cmp < 0 ? &(*n)->left : &(*n)->right;
+        }
+        *n = static_cast<Node *>(mem.calloc(1, sizeof(Node) + len + 1));
+        (*n)->hash = hash;
+        (*n)->len = len;
+        memcpy((*n)->str(), s, len);
+        ++count;
+        return (*n)->str();
+    }
+
+    size_t size() const { return count; }
+
+private:
+    struct Node {
+        Node *left;
+        Node *right;
+        size_t hash;
+        size_t len;
+        char *str() { return reinterpret_cast<char *>(this + 1); }
+    };
+
+    static size_t calcHash(const char *str, size_t len) {
+        size_t hash = 0;
+        for (;;) {
+            uint16_t s;
+            uint32_t i;
+            switch (len) {
+            case 0:
+                return hash;
+            case 1:
+                return hash * 37 + *reinterpret_cast<const uint8_t *>(str);
+            case 2:
+                memcpy(&s, str, 2);
+                return hash * 37 + s;
+            case 3:
+                memcpy(&s, str, 2);
+                return hash * 37 + (s << 8) +
+                       reinterpret_cast<const uint8_t *>(str)[2];
+            default:
+                memcpy(&i, str, 4);
+                hash = hash * 37 + i;
+                str += 4;
+                len -= 4;
+            }
+        }
+    }
+
+    static void freeTree(Node *n) {
+        if (!n)
+            return;
+        freeTree(n->left);
+        freeTree(n->right);
+        mem.free(n);
+    }
+
+    std::vector<Node *> table;
+    size_t count;
+};
+
+double seconds(clock_t start) {
+    return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/// Interns tokens repetitions times in both tables, each time starting from an
+/// empty table (of the size the lexer uses), as every compilation does.
+/// Returns false if the tables disagree.
+bool run(const char *name, const std::vector<Token> &tokens,
+         unsigned repetitions) {
+    double const total = static_cast<double>(tokens.size()) * repetitions;
+
+    size_t unique = 0;
+    clock_t start = clock();
+    for (unsigned r = 0; r < repetitions; ++r) {
+        StringTable table;
+        table._init(6151);
+        unique = 0;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            StringValue *sv = table.update(tokens[i].ptr, tokens[i].len);
+            if (!sv->ptrvalue) {
+                sv->ptrvalue = sv;
+                ++unique;
+            }
+        }
+    }
+    double const time = seconds(start);
+
+    size_t treeUnique = 0;
+    start = clock();
+    for (unsigned r = 0; r < repetitions; ++r) {
+        TreeStringTable table;
+        for (size_t i = 0; i < tokens.size(); ++i)
+            table.update(tokens[i].ptr, tokens[i].len);
+        treeUnique = table.size();
+    }
+    double const treeTime = seconds(start);
+
+    printf("%s: %u strings, %u distinct\n", name,
+           static_cast<unsigned>(tokens.size()), static_cast<unsigned>(unique));
+    printf("  StringTable   %8.3f s  %8.2f M/s\n", time,
+           time > 0 ? total / time / 1e6 : 0.0);
+    printf("  tree buckets  %8.3f s  %8.2f M/s\n", treeTime,
+           treeTime > 0 ? total / treeTime / 1e6 : 0.0);
+
+    if (unique != treeUnique) {
+        fprintf(stderr, "mismatch: %u distinct strings in the old table\n",
+                static_cast<unsigned>(treeUnique));
+        return false;
+    }
+    return true;
+}
+}
+
+int main(int argc, char **argv) {
+    unsigned repetitions = 10;
+    std::vector<std::string> sources;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            repetitions = static_cast<unsigned>(atoi(argv[++i]));
+            continue;
+        }
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            fprintf(stderr, "cannot read '%s'\n", argv[i]);
+            return 1;
+        }
+        std::string src;
+        char buf[64 * 1024];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            src.append(buf, n);
+        fclose(f);
+        sources.push_back(src);
+    }
+    if (sources.empty()) {
+        fprintf(stderr, "usage: %s [-n <repetitions>] <file.d>...\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Token> tokens;
+    for (size_t i = 0; i < sources.size(); ++i)
+        scanIdentifiers(sources[i], tokens);
+
+    // Qualified names of adjacent identifiers, standing in for the many
+    // distinct mangled names and generated identifiers of large builds.
+    std::string names;
+    for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+        names.append(tokens[i].ptr, tokens[i].len);
+        names += '.';
+        names.append(tokens[i + 1].ptr, tokens[i + 1].len);
+        names += ' ';
+    }
+    std::vector<Token> qualified;
+    for (size_t pos = 0; pos < names.size();) {
+        size_t const next = names.find(' ', pos);
+        Token t;
+        t.ptr = names.data() + pos;
+        t.len = next - pos;
+        qualified.push_back(t);
+        pos = next + 1;
+    }
+
+    printf("%u files, %u repetitions\n", static_cast<unsigned>(sources.size()),
+           repetitions);
+    bool ok = run("identifiers", tokens, repetitions);
+    ok = run("qualified names", qualified, repetitions) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+# Tests the per-site call and statement counts of -vctfe-profile-json,
+# invoked by tests/d2/CMakeLists.txt as
+#
+#   cmake -DLDC=<ldc2> -DOUTDIR=<dir> -P ctfeprofile.cmake
+#
+# fib in compilable/ctfe_profile.d would be run as bytecode, which is turned
+# off while profiling, so every recursive call is counted. It executes two
+# statements (the if and a return) per call. It must have one entry per
+# top-level evaluation it was called from, keyed by the line of that
+# evaluation.
+
+set(test ${CMAKE_CURRENT_LIST_DIR}/compilable/ctfe_profile.d)
+
+file(REMOVE_RECURSE ${OUTDIR})
+file(MAKE_DIRECTORY ${OUTDIR})
+
+execute_process(COMMAND ${LDC} -vctfe-profile-json=${OUTDIR}/profile.json
+                        -c -o- ${test}
+                RESULT_VARIABLE result
+                ERROR_VARIABLE output)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "ctfe_profile.d failed to compile:\n${output}")
+endif()
+file(READ ${OUTDIR}/profile.json json)
+
+# line of the evaluation:number of calls of fib
+set(expected
+    34:15   # Nested.value = fib(5)
+    37:177  # a = fib(10)
+    38:465  # b = fib(12)
+    39:5    # c = classify(3), calls fib(3)
+    40:1    # d = classify(0) + classify(1), calls fib(1)
+)
+
+string(REGEX MATCHALL "\"name\" : \"ctfe_profile\\.fib\",[^}]*" entries "${json}")
+list(LENGTH entries count)
+list(LENGTH expected expected_count)
+if(NOT count EQUAL expected_count)
+    message(FATAL_ERROR "expected ${expected_count} profiles of fib, got ${count}:\n${json}")
+endif()
+
+foreach(site ${expected})
+    string(REGEX REPLACE ":.*" "" line "${site}")
+    string(REGEX REPLACE ".*:" "" calls "${site}")
+    math(EXPR statements "2 * ${calls}")
+    set(found FALSE)
+    foreach(entry ${entries})
+        if(entry MATCHES "\"evaluatedFrom\" : \"[^\"]*\\(${line}\\)\"")
+            set(found TRUE)
+            if(NOT entry MATCHES "\"calls\" : ${calls},")
+                message(FATAL_ERROR "fib from line ${line} should have ${calls} calls:\n${entry}")
+            endif()
+            if(NOT entry MATCHES "\"statements\" : ${statements},")
+                message(FATAL_ERROR "fib from line ${line} should execute ${statements} statements:\n${entry}")
+            endif()
+            if(NOT entry MATCHES "\"selfStatements\" : ${statements},")
+                message(FATAL_ERROR "fib from line ${line} should execute ${statements} statements itself:\n${entry}")
+            endif()
+        endif()
+    endforeach()
+    if(NOT found)
+        message(FATAL_ERROR "no profile of fib evaluated from line ${line}:\n${json}")
+    endif()
+endforeach()
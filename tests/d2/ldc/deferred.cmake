@@ -0,0 +1,39 @@
+# Tests that the chains of deferred symbols in compilable/deferred_order.d
+# are resolved in a few passes over the deferred symbols, invoked by
+# tests/d2/CMakeLists.txt as
+#
+#   cmake -DLDC=<ldc2> -DOUTDIR=<dir> -P deferred.cmake
+#
+# Every chain has 20 links declared in the opposite order of their
+# dependencies. Running all deferred symbols in each pass needs a pass per
+# link, running them once their dependency has been run only a few passes
+# in total. The counts are taken from the statistics printed by -v.
+
+set(test ${CMAKE_CURRENT_LIST_DIR}/compilable/deferred_order.d)
+
+file(REMOVE_RECURSE ${OUTDIR})
+file(MAKE_DIRECTORY ${OUTDIR})
+
+execute_process(COMMAND ${LDC} -v -c -o- ${test}
+                RESULT_VARIABLE result
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE output)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "deferred_order.d failed to compile:\n${output}")
+endif()
+
+if(NOT output MATCHES "deferred +([0-9]+) passes, ([0-9]+) semantic runs")
+    message(FATAL_ERROR "-v lacks the deferred statistics:\n${output}")
+endif()
+set(passes ${CMAKE_MATCH_1})
+set(runs ${CMAKE_MATCH_2})
+
+if(passes EQUAL 0)
+    message(FATAL_ERROR "no symbols of deferred_order.d were deferred")
+endif()
+if(NOT passes LESS 10)
+    message(FATAL_ERROR "deferred symbols took ${passes} passes, expected less than 10")
+endif()
+if(NOT runs LESS 200)
+    message(FATAL_ERROR "deferred symbols took ${runs} semantic runs, expected less than 200")
+endif()
@@ -0,0 +1,34 @@
+# Tests -incremental with a change to one module, invoked by
+# tests/d2/CMakeLists.txt as
+#
+#   cmake -DLDC=<ldc2> -DOUTDIR=<dir> -P incremental.cmake
+#
+# The template instance used by a.d and b.d is only emitted into b's object
+# file first. After b.d is changed to no longer use it, a's object needs to be
+# recompiled as well for the program to link.
+
+set(srcdir ${CMAKE_CURRENT_LIST_DIR}/incremental)
+
+file(REMOVE_RECURSE ${OUTDIR})
+file(MAKE_DIRECTORY ${OUTDIR}/src)
+foreach(file tmpl.d a.d b.d main.d)
+    configure_file(${srcdir}/${file} ${OUTDIR}/src/${file} COPYONLY)
+endforeach()
+
+function(build_and_run step)
+    execute_process(COMMAND ${LDC} -incremental -od${OUTDIR}/obj
+                            -of${OUTDIR}/app b.d a.d main.d
+                    WORKING_DIRECTORY ${OUTDIR}/src
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${step} build failed")
+    endif()
+    execute_process(COMMAND ${OUTDIR}/app RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${step} build failed to run with status ${result}")
+    endif()
+endfunction()
+
+build_and_run(initial)
+configure_file(${srcdir}/b_changed.d ${OUTDIR}/src/b.d COPYONLY)
+build_and_run(incremental)
@@ -0,0 +1,56 @@
+# Runs a single LDC specific test case, invoked by tests/d2/CMakeLists.txt as
+#
+#   cmake -DLDC=<ldc2> -DMODE=<compilable|runnable|fail_compilation> -DTEST=<file.d>
+#         -DOUTDIR=<dir> -P runtest.cmake
+#
+# compilable tests only need to compile (most check their results with static
+# asserts), runnable tests are linked and run as well. fail_compilation tests
+# must be rejected with an error, not a crash, and every "// ERROR:" line in
+# the test file must be part of the diagnostics. The switches given on a
+# "// REQUIRED_ARGS:" line in the test file are added to the command line,
+# just like in the DMD testsuite.
+
+file(STRINGS ${TEST} required_args REGEX "^// REQUIRED_ARGS:")
+string(REGEX REPLACE "^// REQUIRED_ARGS:" "" required_args "${required_args}")
+separate_arguments(required_args)
+
+file(REMOVE_RECURSE ${OUTDIR})
+file(MAKE_DIRECTORY ${OUTDIR})
+get_filename_component(name ${TEST} NAME_WE)
+
+if(MODE STREQUAL "compilable")
+    execute_process(COMMAND ${LDC} ${required_args} -c -o- ${TEST}
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${TEST} failed to compile")
+    endif()
+elseif(MODE STREQUAL "runnable")
+    execute_process(COMMAND ${LDC} ${required_args} -od${OUTDIR}
+                            -of${OUTDIR}/${name} ${TEST}
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${TEST} failed to compile")
+    endif()
+    execute_process(COMMAND ${OUTDIR}/${name} RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${TEST} failed with status ${result}")
+    endif()
+elseif(MODE STREQUAL "fail_compilation")
+    execute_process(COMMAND ${LDC} ${required_args} -c -o- ${TEST}
+                    RESULT_VARIABLE result
+                    ERROR_VARIABLE output)
+    # A crash is reported as a string instead of an exit status
+    if(result EQUAL 0 OR NOT result MATCHES "^[0-9]+$")
+        message(FATAL_ERROR "${TEST} was not rejected with an error (${result}):\n${output}")
+    endif()
+    file(STRINGS ${TEST} errors REGEX "^// ERROR:")
+    foreach(error ${errors})
+        string(REGEX REPLACE "^// ERROR: *" "" error "${error}")
+        string(FIND "${output}" "${error}" pos)
+        if(pos EQUAL -1)
+            message(FATAL_ERROR "${TEST} lacks the error '${error}':\n${output}")
+        endif()
+    endforeach()
+else()
+    message(FATAL_ERROR "unknown test mode '${MODE}'")
+endif()
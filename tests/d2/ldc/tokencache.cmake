@@ -0,0 +1,22 @@
+# Tests that -token-cache does not change the diagnostics of imported modules,
+# invoked by tests/d2/CMakeLists.txt as
+#
+#   cmake -DLDC=<ldc2> -DOUTDIR=<dir> -P tokencache.cmake
+
+set(srcdir ${CMAKE_CURRENT_LIST_DIR}/tokencache)
+
+file(REMOVE_RECURSE ${OUTDIR})
+file(MAKE_DIRECTORY ${OUTDIR})
+
+foreach(step cold warm)
+    execute_process(COMMAND ${LDC} -token-cache=${OUTDIR}/cache -I${srcdir}
+                            -c -o- ${srcdir}/main.d
+                    RESULT_VARIABLE result
+                    ERROR_VARIABLE output)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${step} compilation failed:\n${output}")
+    endif()
+    if(NOT output MATCHES "octal literals")
+        message(FATAL_ERROR "${step} compilation lacks the deprecation:\n${output}")
+    endif()
+endforeach()